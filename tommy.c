@@ -1,14 +1,40 @@
 /**
  * Dependencies
  */
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE // sockets and mmap under -std=c11
+#endif
 #include <SDL2/SDL.h>
 #include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #ifdef __EMSCRIPTEN__
 #include <emscripten.h>
+#elif defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// browser builds with pthreads simulate in a worker, native builds when asked
+#if defined(__EMSCRIPTEN_PTHREADS__) && !defined(TOMMY_SIM_THREAD)
+#define TOMMY_SIM_THREAD
+#endif
+#ifdef TOMMY_SIM_THREAD
+#define SIM_LOCAL _Thread_local // the worker's world, and the main thread's copy to draw
+#else
+#define SIM_LOCAL
 #endif
 
 /**
@@ -26,11 +52,88 @@
 #define MAX_BULLETS                256
 #define MAX_ENEMIES                 64
 #define MAX_PROPS                  256
+#define MAX_PLAYERS                  2
+#define HORDE_BULLETS            65536
+#define HORDE_ENEMIES            16384
+#define HORDE_PROPS               1024
+#define MAX_POOL_CAPACITY      1048576
+#define ARENA_ALIGN                 16
 #define MAX_BACKGROUND_DOTS       5000
 #define PLAYER_SHOOT_COOLDOWN_SEC 0.4f
 #define ENEMY_FIRE_COOLDOWN_SEC   1.5f
 #define ENEMY_DEATH_TIME_SEC     0.25f
 #define FONT_SCALE                   3
+#define QUALITY_BUDGET_SEC  (1.0f/60.0f)
+#define QUALITY_WINDOW_FRAMES       30
+#define QUALITY_RESTORE_FRAMES     120
+#define QUALITY_RESTORE_MAX_FRAMES 1920
+#define QUALITY_HEADROOM          0.6f
+#define CIRCLE_MAX_RADIUS           16
+#define GLYPH_COUNT                128
+#define TIMER_HZ                   120
+#define WHEEL_BITS                   8
+#define WHEEL_SLOTS    (1<<WHEEL_BITS)
+#define WHEEL_LEVELS                 2
+#define TIMER_SPAWN                  0
+#define ENEMY_TIMER(i)          ((i)+1)
+#define ROLLBACK_TICKS              16
+#define ROLLBACK_RING (2*ROLLBACK_TICKS)
+#define NET_TICK_HZ                 60
+#define NET_MAGIC          0x544F4D59u
+#define NET_QUEUE                  256
+#define NET_PACKET_MAX  (17 + 2*ROLLBACK_TICKS)
+#define SUSPEND_MAGIC      0x544D5356u
+#define SUSPEND_VERSION              7
+#define SUSPEND_FORMAT (SUSPEND_VERSION | NUM_FRAC_BITS << 8) // fixed point has its own
+#define WIRE_REACH                20.0f
+#define WIRE_WORDS    ((SCREEN_W+31)/32)
+#define PARTICLE_CAP            131072
+#define PARTICLE_DRAG             3.0f
+#define PARTICLE_SIZE             2.0f
+#define GRID_CELL                   32
+#define GRID_MARGIN                 64
+#define GRID_COLS ((SCREEN_W + 2*GRID_MARGIN + GRID_CELL-1) / GRID_CELL)
+#define GRID_ROWS ((SCREEN_H + 2*GRID_MARGIN + GRID_CELL-1) / GRID_CELL)
+#define GRID_CELLS (GRID_COLS*GRID_ROWS)
+#define ENEMY_SEPARATION         22.0f
+#define ENEMY_SEPARATION_WEIGHT   1.5f
+#define ENEMY_SEPARATION_MAX         8
+#define CAPTURE_QUEUE_FRAMES         8
+#define CAPTURE_FPS                 60
+#define CAPTURE_GAME_OVER_FRAMES    60
+#define BOT_KITE_NEAR           140.0f
+#define BOT_KITE_FAR            240.0f
+#define BOT_PROBE                18.0f
+#define SOAK_REPORTS                10
+#define LATCH_HISTORY               32
+#define LATCH_MARGIN_SEC         0.002
+#define LATENCY_BUCKETS            100
+#define LATENCY_PENDING             64
+#define SIM_EMIT_QUEUE            4096
+
+/**
+ * Simulation numbers
+ * Positions, velocities and times are num: float by default, or 16.16 fixed
+ * point when built with -DTOMMY_FIXED, so every target computes the same bits
+ * whatever its FPU, compiler contraction and libm. Products of two nums, such
+ * as squared distances, are num2. NUM() turns a constant into a num at
+ * compile time; render code reads nums back through num_to_int/num_to_float.
+ */
+#ifdef TOMMY_FIXED
+typedef int32_t num;
+typedef int64_t num2;
+#define NUM_FRAC_BITS               16
+#define NUM_ONE     (1 << NUM_FRAC_BITS)
+#define NUM(x)  ((num)((x) * 65536.0 + ((x) < 0 ? -0.5 : 0.5)))
+#define NUM_INT(i)    ((num)(i) * NUM_ONE)
+#else
+typedef float num;
+typedef float num2;
+#define NUM_FRAC_BITS                0
+#define NUM_ONE                   1.0f
+#define NUM(x)              ((float)(x))
+#define NUM_INT(i)          ((float)(i))
+#endif
 
 /**
  * Structs
@@ -42,68 +145,538 @@ typedef enum {
 } PropType;
 
 typedef struct {
-    float x, y;
-    PropType kind;
+    num x, y;
     bool alive;
-} StaticProp;
+} Tree;
 
 typedef struct {
-    float x, y;
-    float vx, vy;
-    bool alive;
-    bool from_enemy;
-} Bullet;
+    num x, y;
+} PropSpot; // rocks and wire are fixed for a round
 
 typedef struct {
-    float x, y;
-    float vx, vy;
-    bool alive;
-    float death_timer;
-    float fire_cooldown;
-} Enemy;
+    num x, y;
+    num vx, vy;
+} Bullet; // flags live apart in bullet_flags, so a bullet fills 16 bytes
+
+enum {
+    BULLET_ALIVE      = 1 << 0,
+    BULLET_FROM_ENEMY = 1 << 1
+};
+
+typedef struct {
+    num x, y;
+} Enemy; // read by every collision, grid and draw pass; velocity is never kept
+
+enum {
+    ENEMY_ALIVE    = 1 << 0,
+    ENEMY_DYING    = 1 << 1, // dead, blood still showing, slot not yet reusable
+    ENEMY_CAN_FIRE = 1 << 2  // fire cooldown has expired
+};
 
 typedef struct {
-    float x, y;
-    float aimx, aimy;
-    float shoot_cooldown;
+    num x, y;
+    num aimx, aimy;
+    num shoot_cooldown;
     bool alive;
 } Player;
 
 typedef struct {
-    int x, y;
-    Uint8 r, g, b;
+    uint16_t x, y;
+    uint8_t tone;   // index into dot_palette
 } Dot;
 
+// the packed layouts above are what keeps a horde's working set in cache
+_Static_assert(sizeof(Bullet) == 16, "Bullet should pack into 16 bytes");
+_Static_assert(sizeof(Enemy) == 8, "Enemy should pack into 8 bytes");
+_Static_assert(sizeof(Dot) == 6, "Dot should pack into 6 bytes");
+
+typedef uint16_t InputBits;
+
+enum {
+    INPUT_MOVE_UP    = 1 << 0,
+    INPUT_MOVE_DOWN  = 1 << 1,
+    INPUT_MOVE_LEFT  = 1 << 2,
+    INPUT_MOVE_RIGHT = 1 << 3,
+    INPUT_FIRE_UP    = 1 << 4,
+    INPUT_FIRE_DOWN  = 1 << 5,
+    INPUT_FIRE_LEFT  = 1 << 6,
+    INPUT_FIRE_RIGHT = 1 << 7,
+    INPUT_RESTART    = 1 << 8
+};
+
+typedef struct {
+    InputBits move;     // random walk heading
+    int hold;           // decisions left before picking a new heading
+    int strafe;         // +1 or -1, which way to circle while kiting
+} BotState;
+
+typedef InputBits (*BotThink)(const Player *pl, BotState *st);
+
+typedef struct {
+    const char *name;
+    BotThink think;
+} BotPolicy;
+
+typedef enum {
+    TIMER_NONE,
+    TIMER_ENEMY_FIRE,
+    TIMER_ENEMY_DEATH,
+    TIMER_SPAWN_WAVE
+} TimerKind;
+
+typedef struct {
+    int next, prev;     // slot list links, -1 terminated
+    int slot;           // level*WHEEL_SLOTS + slot of the list it is in
+    uint32_t expires;   // tick the timer fires on
+    TimerKind kind;     // TIMER_NONE when not scheduled
+} Timer;
+
+typedef struct {
+    uint32_t now;       // ticks elapsed this round
+    num accum;          // simulated time not yet turned into ticks
+    int heads[WHEEL_LEVELS][WHEEL_SLOTS];
+} TimerWheel;
+
+typedef struct {
+    unsigned char *base;
+    size_t size;
+    size_t used;
+    size_t snapshot_bytes; // leading part that changes during a round
+    void *mapping;      // set when the arena lives in a mapped suspend file
+    size_t mapping_size;
+} Arena;
+
+typedef struct {
+    int *free;          // stack of free slot indices, last released on top
+    int free_count;
+    int hi;             // one past the highest slot that may be in use
+} SlotPool;
+
+typedef enum {
+    WAVE_STEADY,    // count enemies per event from random edges
+    WAVE_BURST,     // count enemies per event charging from one edge
+    WAVE_RAMP       // like steady, interval slides to interval_end
+} WaveKind;
+
+typedef struct {
+    num start;          // survival time at which the wave takes over
+    WaveKind kind;
+    num interval;       // seconds between spawn events
+    num interval_end;   // ramp only: interval when the next wave starts
+    int count;          // enemies per spawn event
+} Wave;
+
+typedef struct {
+    const char *name;
+    const Wave *waves;
+    int wave_count;
+} WaveScenario;
+
+typedef struct {
+    uint32_t arena_bytes;
+    uint32_t round_id;
+    Player players[MAX_PLAYERS];
+    uint64_t rng_state;
+    uint64_t round_seed;
+    num survival_time;
+    bool game_over;
+    bool game_won;
+    int tree_count, rock_count, wire_count;
+    int bullet_free_count, bullet_hi;
+    int enemy_free_count, enemy_hi;
+    TimerWheel wheel;
+} SnapshotHeader;
+
+typedef struct {
+    uint32_t tick;          // next tick to simulate
+    unsigned char *snapshots; // state before tick t lives in slot t % ROLLBACK_TICKS
+    size_t snapshot_bytes;
+    InputBits inputs[ROLLBACK_RING][MAX_PLAYERS]; // confirmed or predicted, by tick
+    uint32_t known[MAX_PLAYERS]; // inputs are confirmed for ticks below this
+    uint32_t rollback_to;   // earliest mispredicted tick, UINT32_MAX if none
+    double accum;           // real time not yet simulated
+    int rollbacks;
+    int max_depth;
+    double max_resim_ms;
+    int stalls;
+} Rollback;
+
+typedef enum {
+    NET_OFF,
+    NET_LOOPBACK,   // in-process stand-in peer
+    NET_HOST,
+    NET_JOIN
+} NetMode;
+
+typedef struct {
+    Uint8 data[NET_PACKET_MAX];
+    int len;
+    double release;     // when the artificial delay is over
+    bool to_local;      // loopback only: which end receives it
+} NetDatagram;
+
+typedef struct {
+    NetMode mode;
+    int local, remote;  // player indices
+    bool connected;
+    uint32_t seed;
+    uint32_t config;    // peers must agree on capacities and waves
+    int delay_ms;
+    int loss_pct;
+    uint64_t loss_rng;
+    NetDatagram queue[NET_QUEUE];
+    int queue_count;
+    int sent, lost;
+    double start;       // loopback: when the stand-in started playing
+    uint32_t standin_tick; // loopback: ticks the stand-in has played
+    uint32_t standin_seen; // loopback: our inputs that reached the stand-in
+#ifndef __EMSCRIPTEN__
+#ifdef _WIN32
+    SOCKET sock;
+#else
+    int sock;
+#endif
+    struct sockaddr_in peer;
+    bool have_peer;
+#endif
+} Net;
+
+typedef uint32_t u32x4 __attribute__((vector_size(16)));
+typedef float f32x4 __attribute__((vector_size(16)));
+typedef int32_t i32x4 __attribute__((vector_size(16)));
+
+typedef struct {
+    float *x, *y, *vx, *vy;
+    float *life;            // seconds left, dead at or below 0
+    float *fade;            // 1 / lifetime, for the alpha ramp
+    uint32_t *color;        // ARGB
+    uint32_t head, tail;    // ring counters, live particles are in [tail, head)
+    int live;               // counted by the last update
+    uint64_t rng;           // cosmetic only, never the simulation's
+    SDL_Vertex *verts;      // 4 per particle, one batch per frame
+    int *indices;           // 6 per particle, built once
+} Particles;
+
+typedef struct {
+    int count;
+    float speed_min, speed_max;
+    float life_min, life_max;
+    float spread;           // radians either side of the direction
+    uint32_t colors[2];     // each particle takes one at random
+} Emitter;
+
+typedef struct {
+    SDL_Thread *thread;
+    SDL_mutex *lock;
+    SDL_cond *cond;         // signalled whenever a slot is filled or freed
+    uint32_t *slots;        // CAPTURE_QUEUE_FRAMES framebuffers
+    int head;               // oldest filled slot
+    int count;              // filled slots waiting for the writer
+    bool closing;
+    bool failed;
+    const char *path;
+    FILE *y4m;              // NULL when writing a PPM sequence
+    Uint8 *scratch;         // one converted frame, owned by the writer
+    int written;
+    int stalls;             // times the queue was full
+} FrameCapture;
+
+typedef struct {
+    num dt;             // time to simulate
+    InputBits input;    // local player input, when no bot plays
+    bool paused;
+    bool restart;       // start a new round first
+} SimJob;
+
+typedef struct {
+    const Emitter *em;
+    num x, y, dx, dy;
+} EmitRequest;
+
+#ifdef TOMMY_SIM_THREAD
+typedef struct {
+    SnapshotHeader header;
+    unsigned char *base;    // a whole round arena
+    size_t size;
+    int bullet_cap, enemy_cap, prop_cap;
+    num horde_scale, win_time;
+    Dot dots[MAX_BACKGROUND_DOTS];
+    int dot_count;
+} SimFrame; // one finished step, as the main thread draws it
+
+typedef struct {
+    SDL_Thread *thread;
+    SDL_mutex *lock;
+    SDL_cond *cond;         // signalled when a job is posted or finished
+    SimJob job;
+    bool busy;              // the worker owns the back frame until it clears this
+    bool quit;
+    bool failed;
+    bool fresh;             // the back frame holds a step the main thread has not shown
+    int front;              // frame the main thread draws, the worker writes the other
+    SimFrame frames[2];
+    EmitRequest emits[SIM_EMIT_QUEUE]; // effects of the back frame's step, for the main thread to play
+    int emit_count;
+} SimWorker;
+#endif
+
+typedef enum {
+    QUALITY_FULL,
+    QUALITY_HALF_DOTS,
+    QUALITY_QUARTER_DOTS,
+    QUALITY_FLAT_BLOOD,
+    QUALITY_FLAT_SOLDIERS,
+    QUALITY_LEVELS
+} QualityLevel;
+
+typedef struct {
+    QualityLevel level;
+    float window_sum;       // summed frame cost of the current window
+    int window_frames;      // frames in the current window
+    int headroom_frames;    // consecutive frames well under budget
+    int restore_frames;     // headroom frames needed before restoring
+    bool just_restored;     // last change was a restore
+} QualityGovernor;
+
+typedef struct {
+    bool enabled;
+    double period;          // seconds between the presents it paces to
+    float work[LATCH_HISTORY]; // recent seconds from sampling input to present
+    int next;               // oldest entry in work
+    uint64_t last_present;  // counter when the last present returned, 0 before the first
+} LateLatch;
+
+typedef struct {
+    bool enabled;
+    uint32_t pending[LATENCY_PENDING]; // timestamps of input events not yet presented
+    int pending_count;
+    uint32_t in_flight[LATENCY_PENDING]; // taken by a step the worker still runs
+    int in_flight_count;
+    uint32_t buckets[LATENCY_BUCKETS]; // 1 ms each, the last one also takes anything longer
+    uint32_t count;
+    uint64_t sum_ms;
+    uint32_t max_ms;
+} LatencyStats;
+
 /**
  * Globals
  */
-static Player player;
-static Bullet bullets[MAX_BULLETS];
-static Enemy enemies[MAX_ENEMIES];
-static StaticProp props[MAX_PROPS];
-static int prop_count = 0;
-static Dot dots[MAX_BACKGROUND_DOTS];
-static int dot_count = 0;
-static float survival_time = 0.0f;
-static bool game_over = false;
-static bool game_won = false;
-static bool paused = false;
-static bool show_welcome_msg = true;
+static SIM_LOCAL Player players[MAX_PLAYERS];
+static int player_count = 1;
+static SIM_LOCAL uint64_t rng_state = 1;
+static SIM_LOCAL uint32_t round_id = 0; // counts rounds, so a snapshot knows its own
+static SIM_LOCAL uint64_t round_seed = 1; // rng_state the round's dots and props came from
+static SIM_LOCAL int bullet_cap = MAX_BULLETS;
+static SIM_LOCAL int enemy_cap = MAX_ENEMIES;
+static SIM_LOCAL int prop_cap = MAX_PROPS;
+static SIM_LOCAL num horde_scale = NUM_ONE; // enemy capacity relative to the classic game
+static SIM_LOCAL num win_time = NUM(WIN_TIME);
+static SIM_LOCAL Arena arena;
+static SIM_LOCAL Bullet *bullets = NULL;
+static SIM_LOCAL uint8_t *bullet_flags = NULL; // BULLET_* bits per bullet slot
+static SIM_LOCAL Enemy *enemies = NULL;
+static SIM_LOCAL uint8_t *enemy_flags = NULL; // ENEMY_* bits per enemy slot
+static SIM_LOCAL Tree *trees = NULL;
+static SIM_LOCAL PropSpot *rocks = NULL;
+static SIM_LOCAL PropSpot *wires = NULL;
+static SIM_LOCAL uint32_t *wire_bitmap = NULL; // 1 bit per pixel: an actor centred here touches wire
+static SIM_LOCAL Timer *timers = NULL; // one for the spawner, then one per enemy
+static SIM_LOCAL int *prop_start = NULL; // trees and rocks in cell c are prop_items[prop_start[c] .. prop_start[c+1]-1]
+static SIM_LOCAL int *prop_items = NULL; // tree t as t, rock r as ~r
+static SIM_LOCAL int *grid_start = NULL; // enemies in cell c are grid_items[grid_start[c] .. grid_start[c+1]-1]
+static SIM_LOCAL int *grid_items = NULL;
+static SIM_LOCAL int *grid_cells = NULL; // cell each enemy was sorted into
+static SIM_LOCAL SlotPool bullet_pool;
+static SIM_LOCAL SlotPool enemy_pool;
+static SIM_LOCAL int tree_count = 0;
+static SIM_LOCAL int rock_count = 0;
+static SIM_LOCAL int wire_count = 0;
+static const Uint8 dot_palette[][3] = {
+    { 30, 22, 16 },     // darker mud spots
+    { 70, 55, 40 },     // slightly lighter dirt chip
+    { 70, 90, 60 }      // muted moss/lichen dot
+};
+static SIM_LOCAL Dot dot_storage[MAX_BACKGROUND_DOTS];
+static SIM_LOCAL Dot *dots = NULL; // dot_storage, or the suspend file after --resume
+static SIM_LOCAL int dot_count = 0;
+static SIM_LOCAL num survival_time = 0;
+static SIM_LOCAL bool game_over = false;
+static SIM_LOCAL bool game_won = false;
+static SIM_LOCAL bool paused = false;
+static SIM_LOCAL bool resimulating = false; // rollback replaying ticks that already showed
+static Particles fx;
+static SIM_LOCAL bool show_welcome_msg = true;
 static bool running = true;
-static float enemy_spawn_timer = 0.0f;
+static SIM_LOCAL TimerWheel wheel;
+static Rollback rb;
+static Net net;
 static uint64_t prev = 0;
 static double freq = 0;
 static SDL_Window *win = NULL;
+static QualityGovernor quality = { QUALITY_FULL, 0.0f, 0, 0, QUALITY_RESTORE_FRAMES, false };
+static bool verbose = false; // log renderer decisions such as quality changes
+static LateLatch latch;
+static LatencyStats latency;
+#ifdef TOMMY_SIM_THREAD
+static SimWorker sim;
+static SIM_LOCAL bool on_sim_worker = false;
+#endif
+static bool soft_render = false;
+static uint32_t *soft_fb = NULL;
+static SDL_Texture *soft_tex = NULL;
+static uint32_t soft_color = 0;
+static Uint8 circle_spans[CIRCLE_MAX_RADIUS+1][2*CIRCLE_MAX_RADIUS+1];
+static Uint8 glyph_rows[GLYPH_COUNT][5];
+
+/**
+ * Wave scenarios
+ * Each wave runs from its start until the next one begins, or the round ends.
+ */
+static const Wave waves_classic[] = {
+    { NUM( 0.0f), WAVE_STEADY, NUM(1.0f), NUM( 1.0f),  1 },
+};
+static const Wave waves_burst[] = {
+    { NUM( 0.0f), WAVE_STEADY, NUM(1.0f), NUM( 1.0f),  1 },
+    { NUM(15.0f), WAVE_BURST,  NUM(5.0f), NUM( 5.0f),  8 },
+    { NUM(45.0f), WAVE_STEADY, NUM(0.5f), NUM( 0.5f),  1 },
+};
+static const Wave waves_ramp[] = {
+    { NUM( 0.0f), WAVE_RAMP,   NUM(1.5f), NUM( 0.1f),  1 },
+};
+static const Wave waves_siege[] = {
+    { NUM( 0.0f), WAVE_BURST,  NUM(2.0f), NUM( 2.0f), 16 },
+    { NUM(20.0f), WAVE_RAMP,   NUM(0.5f), NUM(0.05f),  2 },
+    { NUM(40.0f), WAVE_BURST,  NUM(1.0f), NUM( 1.0f), 32 },
+};
+static const WaveScenario scenarios[] = {
+    { "classic", waves_classic, sizeof(waves_classic)/sizeof(Wave) },
+    { "burst",   waves_burst,   sizeof(waves_burst)/sizeof(Wave) },
+    { "ramp",    waves_ramp,    sizeof(waves_ramp)/sizeof(Wave) },
+    { "siege",   waves_siege,   sizeof(waves_siege)/sizeof(Wave) },
+};
+static const WaveScenario *scenario = &scenarios[0];
 
 /**
  * Helper functions
  */
-static float frand01(void) {
-    return (float)rand() / (float)RAND_MAX;
+static uint32_t xorshift64s(uint64_t *state) {
+    // xorshift64*, so the whole game state fits in a snapshot
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return (uint32_t)((*state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static uint32_t rng_next(void) {
+    return xorshift64s(&rng_state);
+}
+
+static void rng_seed(uint64_t seed) {
+    rng_state = seed * 0x9E3779B97F4A7C15ULL;
+    if (rng_state == 0) rng_state = 1;
+}
+
+#ifdef TOMMY_FIXED
+// right shifts of negative values are arithmetic on every supported compiler
+static num num_mul(num a, num b) {
+    return (num)(((int64_t)a * b) >> NUM_FRAC_BITS);
+}
+
+static num num_div(num a, num b) {
+    return (num)((int64_t)a * NUM_ONE / b);
+}
+
+static num2 num_sq(num a) {
+    return (num2)a * a;
+}
+
+static num num_abs(num a) {
+    return a < 0 ? -a : a;
+}
+
+static int num_to_int(num a) {
+    return a >> NUM_FRAC_BITS;
+}
+
+static int num_round(num a) {
+    return (a + NUM_ONE/2) >> NUM_FRAC_BITS;
+}
+
+static float num_to_float(num a) {
+    return a / 65536.0f;
+}
+
+static num num_from_float(float f) {
+    return (num)floorf(f * 65536.0f + 0.5f);
+}
+
+static num num_ratio(int a, int b) {
+    return (num)(((int64_t)a << NUM_FRAC_BITS) / b);
+}
+
+// bit-by-bit square root, exact floor on every target
+static uint32_t isqrt64(uint64_t v) {
+    uint64_t r = 0;
+    uint64_t bit = 1ULL << 62;
+    while (bit > v) bit >>= 2;
+    while (bit) {
+        if (v >= r + bit) {
+            v -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)r;
+}
+
+static num num_log2(num x) {
+    // integer part by halving, then one fraction bit per squaring
+    num r = 0;
+    while (x >= 2*NUM_ONE) {
+        x >>= 1;
+        r += NUM_ONE;
+    }
+    for (num b = NUM_ONE/2; b > 0; b >>= 1) {
+        x = num_mul(x, x);
+        if (x >= 2*NUM_ONE) {
+            x >>= 1;
+            r += b;
+        }
+    }
+    return r;
+}
+
+static num frand01(void) {
+    return (num)(rng_next() >> 16);
+}
+
+static num length(num x, num y) {
+    return (num)isqrt64((uint64_t)(num_sq(x) + num_sq(y)));
+}
+
+static void normalize(num *x, num *y) {
+    num L = length(*x, *y);
+    if (L > NUM(0.0001f)) {
+        *x = num_div(*x, L);
+        *y = num_div(*y, L);
+    }
 }
+#else
+static num num_mul(num a, num b) { return a * b; }
+static num num_div(num a, num b) { return a / b; }
+static num2 num_sq(num a) { return a * a; }
+static num num_abs(num a) { return fabsf(a); }
+static int num_to_int(num a) { return (int)a; }
+static int num_round(num a) { return (int)(a + 0.5f); }
+static float num_to_float(num a) { return a; }
+static num num_from_float(float f) { return f; }
+static num num_ratio(int a, int b) { return (float)a / b; }
+static num num_log2(num x) { return log2f(x); }
 
-static float frand_range(float a, float b) {
-    return a + frand01()*(b-a);
+static float frand01(void) {
+    return (float)(rng_next() >> 8) / 16777216.0f;
 }
 
 static float length(float x, float y) {
@@ -117,496 +690,1509 @@ static void normalize(float *x, float *y) {
         *y /= L;
     }
 }
+#endif
+
+static num frand_range(num a, num b) {
+    return a + num_mul(frand01(), b-a);
+}
 
-static float dist2(float ax, float ay, float bx, float by) {
-    float dx = ax - bx;
-    float dy = ay - by;
-    return dx*dx + dy*dy;
+static num2 dist2(num ax, num ay, num bx, num by) {
+    num dx = ax - bx;
+    num dy = ay - by;
+    return num_sq(dx) + num_sq(dy);
 }
 
-static bool circle_hit(float ax, float ay, float ar, float bx, float by, float br) {
-    float dx = ax - bx;
-    float dy = ay - by;
-    float rr = ar + br;
-    return (dx*dx + dy*dy) <= rr*rr;
+static bool circle_hit(num ax, num ay, num ar, num bx, num by, num br) {
+    return dist2(ax, ay, bx, by) <= num_sq(ar + br);
 }
 
 /**
- * Add background dots
+ * Player lookups
  */
-static void generate_dots(void) {
-    dot_count = 0;
-    for (int i=0; i<MAX_BACKGROUND_DOTS; i++) {
-        Dot d;
-        d.x = (int)frand_range(0.0f, (float)SCREEN_W);
-        d.y = (int)frand_range(0.0f, (float)SCREEN_H);
+static bool any_player_alive(void) {
+    for (int p=0; p<player_count; p++) {
+        if (players[p].alive) return true;
+    }
+    return false;
+}
 
-        // pick one of a few earthy tones
-        float pick = frand01();
-        if (pick < 0.5f) {
-            // darker mud spots
-            d.r = 30; d.g = 22; d.b = 16;
-        } else if (pick < 0.8f) {
-            // slightly lighter dirt chip
-            d.r = 70; d.g = 55; d.b = 40;
-        } else {
-            // muted moss/lichen dot
-            d.r = 70; d.g = 90; d.b = 60;
+static Player *nearest_player(num x, num y) {
+    Player *best = NULL;
+    num2 best_d2 = 0;
+    for (int p=0; p<player_count; p++) {
+        if (!players[p].alive) continue;
+        num2 d2 = dist2(players[p].x, players[p].y, x, y);
+        if (!best || d2 < best_d2) {
+            best = &players[p];
+            best_d2 = d2;
         }
-
-        dots[dot_count++] = d;
-        if (dot_count >= MAX_BACKGROUND_DOTS) break;
     }
+    return best;
 }
 
 /**
- * Add battlefield props
+ * Timer wheel
+ * Two-level hierarchical wheel of 1/TIMER_HZ ticks. Level 0 holds timers due
+ * within WHEEL_SLOTS ticks, level 1 the rest in WHEEL_SLOTS-tick buckets that
+ * cascade down as level 0 wraps. Advancing costs O(ticks + timers fired),
+ * independent of how many timers are pending. Timer ids are fixed: enemy i
+ * owns ENEMY_TIMER(i), and TIMER_SPAWN drives the wave scheduler.
  */
-static void generate_props(void) {
-    prop_count = 0;
-    for (int i=0; i<MAX_PROPS; i++) {
-        float r = frand01();
-        PropType k;
-        if (r < 0.8f)      k = PROP_TREE;
-        else if (r < 0.9f) k = PROP_ROCK;
-        else               k = PROP_WIRE;
+static void timer_link(int id) {
+    Timer *t = &timers[id];
+    uint32_t delta = t->expires - wheel.now;
+    if (delta < WHEEL_SLOTS) {
+        t->slot = t->expires & (WHEEL_SLOTS-1);
+    } else if (delta < (uint32_t)WHEEL_SLOTS*WHEEL_SLOTS) {
+        t->slot = WHEEL_SLOTS + ((t->expires >> WHEEL_BITS) & (WHEEL_SLOTS-1));
+    } else {
+        // beyond the wheel: park in the furthest bucket, relinked on cascade
+        t->slot = WHEEL_SLOTS + (((wheel.now >> WHEEL_BITS) - 1) & (WHEEL_SLOTS-1));
+    }
+    int *head = &wheel.heads[0][0] + t->slot;
+    t->prev = -1;
+    t->next = *head;
+    if (*head >= 0) timers[*head].prev = id;
+    *head = id;
+}
 
-        float x = frand_range(30.0f, SCREEN_W - 30.0f);
-        float y = frand_range(30.0f, SCREEN_H - 30.0f);
+static void timer_unlink(int id) {
+    Timer *t = &timers[id];
+    if (t->prev >= 0) {
+        timers[t->prev].next = t->next;
+    } else {
+        (&wheel.heads[0][0])[t->slot] = t->next;
+    }
+    if (t->next >= 0) timers[t->next].prev = t->prev;
+    t->next = t->prev = -1;
+}
 
-        // avoid spawn zone
-        float d2c = dist2(x, y, SCREEN_W/2.0f, SCREEN_H/2.0f);
-        if (d2c < 100.0f*100.0f) {
-            i--;
-            continue;
-        }
+static void timer_cancel(int id) {
+    if (timers[id].kind == TIMER_NONE) return;
+    timer_unlink(id);
+    timers[id].kind = TIMER_NONE;
+}
 
-        props[prop_count].x = x;
-        props[prop_count].y = y;
-        props[prop_count].kind = k;
-        props[prop_count].alive = true;
-        prop_count++;
+static void timer_schedule(int id, TimerKind kind, num seconds) {
+    timer_cancel(id);
+    uint32_t ticks = (uint32_t)num_round(seconds * TIMER_HZ);
+    if (ticks < 1) ticks = 1;
+    timers[id].expires = wheel.now + ticks;
+    timers[id].kind = kind;
+    timer_link(id);
+}
 
-        if (prop_count >= MAX_PROPS) break;
+static void timer_reset(void) {
+    wheel.now = 0;
+    wheel.accum = 0;
+    for (int l=0; l<WHEEL_LEVELS; l++) {
+        for (int s=0; s<WHEEL_SLOTS; s++) wheel.heads[l][s] = -1;
+    }
+    for (int i=0; i<enemy_cap+1; i++) {
+        timers[i].next = timers[i].prev = -1;
+        timers[i].slot = -1;
+        timers[i].kind = TIMER_NONE;
     }
 }
 
 /**
- * Reset the game
+ * Round arena
+ * Every per-round pool comes out of one allocation made when a round starts
+ * and released at reset, so capacities can be chosen at runtime.
  */
-static void reset_game(void) {
-    player.x = SCREEN_W/2.0f;
-    player.y = SCREEN_H/2.0f;
-    player.aimx = 0.0f;
-    player.aimy = -1.0f;
-    player.shoot_cooldown = 0.0f;
-    player.alive = true;
+static size_t arena_size(size_t bytes) {
+    return (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
 
-    for (int i=0;i<MAX_BULLETS;i++) {
-        bullets[i].alive = false;
-    }
-    for (int i=0;i<MAX_ENEMIES;i++) {
-        enemies[i].alive = false;
-        enemies[i].death_timer = 0;
-        enemies[i].fire_cooldown = ENEMY_FIRE_COOLDOWN_SEC;
-    }
+static void *arena_alloc(size_t bytes) {
+    void *p = arena.base + arena.used;
+    arena.used += arena_size(bytes);
+    return p;
+}
 
-    generate_dots();
-    generate_props();
+static void unmap_file(void *mapping, size_t size) {
+#ifdef __EMSCRIPTEN__
+    (void)mapping; (void)size;
+#elif defined(_WIN32)
+    (void)size;
+    UnmapViewOfFile(mapping);
+#else
+    munmap(mapping, size);
+#endif
+}
 
-    survival_time = 0.0f;
-    enemy_spawn_timer = 0.0f;
-    game_over = false;
-    game_won = false;
-    if(show_welcome_msg) {
-        paused = true;
+static void release_round(void) {
+    if (arena.mapping) {
+        unmap_file(arena.mapping, arena.mapping_size);
+        dots = dot_storage;
     } else {
-        paused = false;
+        free(arena.base);
     }
+    memset(&arena, 0, sizeof(arena));
+    bullets = NULL;
+    bullet_flags = NULL;
+    enemies = NULL;
+    enemy_flags = NULL;
+    trees = NULL;
+    rocks = NULL;
+    wires = NULL;
+    wire_bitmap = NULL;
+    timers = NULL;
+    prop_start = NULL;
+    prop_items = NULL;
+    grid_start = NULL;
+    grid_items = NULL;
+    grid_cells = NULL;
 }
 
-/**
- * Spawn bullet
- */
-static void spawn_bullet(float x, float y, float dx, float dy, float speed, bool from_enemy) {
-    for (int i=0; i<MAX_BULLETS; i++) {
-        if (!bullets[i].alive) {
-            normalize(&dx,&dy);
-            bullets[i].x = x;
-            bullets[i].y = y;
-            bullets[i].vx = dx * speed;
-            bullets[i].vy = dy * speed;
-            bullets[i].alive = true;
-            bullets[i].from_enemy = from_enemy;
-            return;
-        }
-    }
+static size_t round_bytes(void) {
+    return arena_size(sizeof(Bullet) * bullet_cap)
+         + arena_size(sizeof(uint8_t) * bullet_cap)
+         + arena_size(sizeof(int) * bullet_cap)
+         + arena_size(sizeof(Enemy) * enemy_cap)
+         + arena_size(sizeof(uint8_t) * enemy_cap)
+         + arena_size(sizeof(int) * enemy_cap)
+         + arena_size(sizeof(Timer) * (enemy_cap+1))
+         + arena_size(sizeof(Tree) * prop_cap)
+         + arena_size(sizeof(PropSpot) * prop_cap)
+         + arena_size(sizeof(PropSpot) * prop_cap)
+         + arena_size(sizeof(uint32_t) * WIRE_WORDS * SCREEN_H)
+         + arena_size(sizeof(int) * (GRID_CELLS+1))
+         + arena_size(sizeof(int) * prop_cap)
+         + arena_size(sizeof(int) * (GRID_CELLS+1))
+         + arena_size(sizeof(int) * enemy_cap)
+         + arena_size(sizeof(int) * enemy_cap);
 }
 
 /**
- * Let player fire
+ * Carve the pools out of arena.base, which must hold round_bytes(). Whatever
+ * the simulation changes comes first, so snapshots copy only that part; rocks,
+ * wire, the wire bitmap and the prop grid are set when the round is generated
+ * and then left alone, and the neighbour grid at the end is scratch rebuilt
+ * before each use. A rollback can still reach back past a restart into the
+ * previous round, so load_snapshot generates that round's part again.
  */
-static void try_player_fire(void) {
-    if (!player.alive) return;
-    if (player.shoot_cooldown > 0.0f) return;
-
-    float dx = player.aimx;
-    float dy = player.aimy;
-    if (fabsf(dx) < 0.0001f && fabsf(dy) < 0.0001f) {
-        dx = 0.0f; dy = -1.0f;
-    }
+static void layout_round(void) {
+    arena.used = 0;
+    bullets = arena_alloc(sizeof(Bullet) * bullet_cap);
+    bullet_flags = arena_alloc(sizeof(uint8_t) * bullet_cap);
+    bullet_pool.free = arena_alloc(sizeof(int) * bullet_cap);
+    enemies = arena_alloc(sizeof(Enemy) * enemy_cap);
+    enemy_flags = arena_alloc(sizeof(uint8_t) * enemy_cap);
+    enemy_pool.free = arena_alloc(sizeof(int) * enemy_cap);
+    timers = arena_alloc(sizeof(Timer) * (enemy_cap+1));
+    trees = arena_alloc(sizeof(Tree) * prop_cap);
+    arena.snapshot_bytes = arena.used;
+    rocks = arena_alloc(sizeof(PropSpot) * prop_cap);
+    wires = arena_alloc(sizeof(PropSpot) * prop_cap);
+    wire_bitmap = arena_alloc(sizeof(uint32_t) * WIRE_WORDS * SCREEN_H);
+    prop_start = arena_alloc(sizeof(int) * (GRID_CELLS+1));
+    prop_items = arena_alloc(sizeof(int) * prop_cap);
+    grid_start = arena_alloc(sizeof(int) * (GRID_CELLS+1));
+    grid_items = arena_alloc(sizeof(int) * enemy_cap);
+    grid_cells = arena_alloc(sizeof(int) * enemy_cap);
+}
 
-    spawn_bullet(player.x, player.y, dx, dy, BULLET_SPEED, false);
-    player.shoot_cooldown = PLAYER_SHOOT_COOLDOWN_SEC;
+static bool alloc_round(void) {
+    arena.size = round_bytes();
+    arena.base = calloc(1, arena.size); // zeroed, so padding and unused slots hash the same
+    if (!arena.base) return false;
+    layout_round();
+    return true;
 }
 
 /**
- * Let enemy fire
+ * Waves and the time to survive grow with the enemy capacity
  */
-static void enemy_try_fire(Enemy *e) {
-    if (!e->alive) return;
-    if (e->fire_cooldown > 0.0f) return;
-    if (!player.alive) return;
-
-    float dx = player.x - e->x;
-    float dy = player.y - e->y;
-    float d2p = dist2(player.x, player.y, e->x, e->y);
-    if (d2p > 250.0f*250.0f) {
-        return;
-    }
-
-    spawn_bullet(e->x, e->y, dx, dy, ENEMY_BULLET_SPEED, true);
-    e->fire_cooldown = ENEMY_FIRE_COOLDOWN_SEC;
+static void scale_horde(void) {
+    horde_scale = num_ratio(enemy_cap, MAX_ENEMIES);
+    if (horde_scale < NUM_ONE) horde_scale = NUM_ONE;
+    // a bigger horde takes the cavalry longer to cut through
+    win_time = num_mul(NUM(WIN_TIME), NUM_ONE + num_log2(horde_scale));
 }
 
 /**
- * Spawn enemies
+ * Slot pools start out handing slots in index order; after that a released
+ * slot goes on top of the stack and is the next one taken. The move passes
+ * trim hi while the highest slots are dead, so after a burst it stays high
+ * until the slots at the top die; it never cuts off a live slot.
  */
-static void spawn_enemy(void) {
-    int idx = -1;
-    for (int i=0;i<MAX_ENEMIES;i++) {
-        if (!enemies[i].alive && enemies[i].death_timer <= 0.0f) {
-            idx = i; break;
-        }
-    }
-    if (idx < 0) return;
+static void pool_reset(SlotPool *pool, int cap) {
+    for (int i=0; i<cap; i++) pool->free[i] = cap-1-i;
+    pool->free_count = cap;
+    pool->hi = 0;
+}
 
-    int edge = rand()%4;
-    float x,y;
-    if (edge==0) { // top
-        x = frand_range(0, SCREEN_W);
-        y = -20;
-    } else if (edge==1) { // bottom
-        x = frand_range(0, SCREEN_W);
-        y = SCREEN_H + 20;
-    } else if (edge==2) { // left
-        x = -20;
-        y = frand_range(0, SCREEN_H);
-    } else { // right
-        x = SCREEN_W + 20;
-        y = frand_range(0, SCREEN_H);
-    }
+static int pool_take(SlotPool *pool) {
+    if (pool->free_count == 0) return -1;
+    int i = pool->free[--pool->free_count];
+    if (i >= pool->hi) pool->hi = i+1;
+    return i;
+}
 
-    enemies[idx].x = x;
-    enemies[idx].y = y;
-    enemies[idx].alive = true;
-    enemies[idx].death_timer = 0;
-    enemies[idx].fire_cooldown = ENEMY_FIRE_COOLDOWN_SEC;
+static void pool_release(SlotPool *pool, int i) {
+    pool->free[pool->free_count++] = i;
 }
 
 /**
- * Player controls
+ * Add background dots
  */
-static void control_player(float dt, const Uint8 *keys) {
-    if (!player.alive) return;
-
-    // W A S D to move
-    float mx = 0.0f;
-    float my = 0.0f;
-    if (keys[SDL_SCANCODE_W]) my -= 1.0f;
-    if (keys[SDL_SCANCODE_S]) my += 1.0f;
-    if (keys[SDL_SCANCODE_A]) mx -= 1.0f;
-    if (keys[SDL_SCANCODE_D]) mx += 1.0f;
-
-    float mvx = mx;
-    float mvy = my;
-    normalize(&mvx,&mvy);
-
-    player.x += mvx * PLAYER_SPEED * dt;
-    player.y += mvy * PLAYER_SPEED * dt;
-
-    // clamp to map
-    if (player.x < 10) player.x = 10;
-    if (player.x > SCREEN_W-10) player.x = SCREEN_W-10;
-    if (player.y < 10) player.y = 10;
-    if (player.y > SCREEN_H-10) player.y = SCREEN_H-10;
-
-    // I J K L to aim and fire
-    float ax = 0.0f;
-    float ay = 0.0f;
-    bool aiming_now = false;
-
-    if (keys[SDL_SCANCODE_I]) { ay -= 1.0f; aiming_now = true; }
-    if (keys[SDL_SCANCODE_K]) { ay += 1.0f; aiming_now = true; }
-    if (keys[SDL_SCANCODE_J]) { ax -= 1.0f; aiming_now = true; }
-    if (keys[SDL_SCANCODE_L]) { ax += 1.0f; aiming_now = true; }
+static void generate_dots(void) {
+    dots = dot_storage;
+    dot_count = 0;
+    for (int i=0; i<MAX_BACKGROUND_DOTS; i++) {
+        Dot d = { 0 };
+        d.x = (uint16_t)num_to_int(frand_range(0, NUM_INT(SCREEN_W)));
+        d.y = (uint16_t)num_to_int(frand_range(0, NUM_INT(SCREEN_H)));
 
-    if (aiming_now) {
-        player.aimx = ax;
-        player.aimy = ay;
-        normalize(&player.aimx, &player.aimy);
-        try_player_fire();
-    }
+        // pick one of a few earthy tones
+        num pick = frand01();
+        if (pick < NUM(0.5f)) d.tone = 0;
+        else if (pick < NUM(0.8f)) d.tone = 1;
+        else d.tone = 2;
 
-    if (player.shoot_cooldown > 0.0f) {
-        player.shoot_cooldown -= dt;
-        if (player.shoot_cooldown < 0.0f) player.shoot_cooldown = 0.0f;
+        dots[dot_count++] = d;
+        if (dot_count >= MAX_BACKGROUND_DOTS) break;
     }
 }
 
 /**
- * Move bullets
+ * Mark every pixel where an actor's centre would touch the given wire
  */
-static void move_bullets(float dt) {
-    for (int i=0;i<MAX_BULLETS;i++) {
-        if (!bullets[i].alive) continue;
-        bullets[i].x += bullets[i].vx * dt;
-        bullets[i].y += bullets[i].vy * dt;
-
-        if (bullets[i].x < -50 || bullets[i].x > SCREEN_W+50 ||
-            bullets[i].y < -50 || bullets[i].y > SCREEN_H+50) {
-            bullets[i].alive = false;
+static void rasterize_wire(num wx, num wy) {
+    int x0 = num_to_int(wx - NUM(WIRE_REACH)), x1 = num_to_int(wx + NUM(WIRE_REACH)) + 1;
+    int y0 = num_to_int(wy - NUM(WIRE_REACH)), y1 = num_to_int(wy + NUM(WIRE_REACH)) + 1;
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > SCREEN_W-1) x1 = SCREEN_W-1;
+    if (y1 > SCREEN_H-1) y1 = SCREEN_H-1;
+    for (int y=y0; y<=y1; y++) {
+        for (int x=x0; x<=x1; x++) {
+            if (dist2(NUM_INT(x) + NUM(0.5f), NUM_INT(y) + NUM(0.5f), wx, wy) <= num_sq(NUM(WIRE_REACH))) {
+                wire_bitmap[y*WIRE_WORDS + (x >> 5)] |= 1u << (x & 31);
+            }
         }
     }
 }
 
 /**
- * Move enemies
+ * Wire check for an actor of radius ~10 against wire of radius ~10
  */
-static void move_enemies(float dt) {
-    for (int i=0;i<MAX_ENEMIES;i++) {
-        Enemy *e = &enemies[i];
-
-        if (e->alive) {
-            // chase player
-            float dx = player.x - e->x;
-            float dy = player.y - e->y;
-            normalize(&dx,&dy);
+static bool touches_wire(num x, num y) {
+    if (x < 0 || y < 0 || x >= NUM_INT(SCREEN_W) || y >= NUM_INT(SCREEN_H)) return false;
+    int px = num_to_int(x), py = num_to_int(y);
+    return (wire_bitmap[py*WIRE_WORDS + (px >> 5)] >> (px & 31)) & 1u;
+}
 
-            e->vx = dx * ENEMY_SPEED;
-            e->vy = dy * ENEMY_SPEED;
+/**
+ * Grid cells
+ * The battlefield and a margin around it in GRID_CELL squares, shared by the
+ * prop grid and the enemy neighbour grid
+ */
+static int grid_col(num x) {
+    int p = num_to_int(x) + GRID_MARGIN;
+    if (p < 0) return 0;
+    return p / GRID_CELL < GRID_COLS ? p / GRID_CELL : GRID_COLS-1;
+}
 
-            e->x += e->vx * dt;
-            e->y += e->vy * dt;
+static int grid_row(num y) {
+    int p = num_to_int(y) + GRID_MARGIN;
+    if (p < 0) return 0;
+    return p / GRID_CELL < GRID_ROWS ? p / GRID_CELL : GRID_ROWS-1;
+}
 
-            // try to shoot
-            e->fire_cooldown -= dt;
-            if (e->fire_cooldown < 0.0f) e->fire_cooldown = 0.0f;
-            enemy_try_fire(e);
-
-            // bayonet melee kill the player
-            if (player.alive) {
-                float d2p = dist2(player.x, player.y, e->x, e->y);
-                if (d2p < 12.0f*12.0f) {
-                    player.alive = false;
-                }
-            }
-        } else {
-            if (e->death_timer > 0.0f) {
-                e->death_timer -= dt;
-                if (e->death_timer < 0.0f) e->death_timer = 0.0f;
-            }
-        }
-    }
+static int grid_cell(num x, num y) {
+    return grid_row(y) * GRID_COLS + grid_col(x);
 }
 
 /**
- * Environment interactions
+ * Prop grid
+ * Trees and rocks never move, so they are sorted into cells once per round,
+ * with the same counting sort as the neighbour grid. Each cell lists its
+ * trees in ascending index order, then its rocks. Bullets are smaller than
+ * a cell, so a bullet only meets props in the 3x3 cells around it.
  */
-static void handle_props_effects(void) {
-    // bullets vs props
-    for (int b=0; b<MAX_BULLETS; b++) {
-        if (!bullets[b].alive) continue;
-
-        for (int p=0; p<prop_count; p++) {
-            if (!props[p].alive) continue;
-
-            float px = props[p].x;
-            float py = props[p].y;
-            float bx = bullets[b].x;
-            float by = bullets[b].y;
-
-            switch (props[p].kind) {
-                case PROP_TREE:
-                    // trees get destroyed by any bullet
-                    // tree radius ~12, bullet ~2
-                    if (circle_hit(px, py, 12.0f, bx, by, 2.0f)) {
-                        props[p].alive = false;
-                        bullets[b].alive = false;
-                        break;
-                    }
-                    break;
-
-                case PROP_ROCK:
-                    // rock absorbs bullet, radius ~10
-                    if (circle_hit(px, py, 10.0f, bx, by, 2.0f)) {
-                        bullets[b].alive = false;
-                        break;
-                    }
-                    break;
+static void prop_grid_build(void) {
+    memset(prop_start, 0, sizeof(int) * (GRID_CELLS+1));
+    for (int t=0; t<tree_count; t++) prop_start[grid_cell(trees[t].x, trees[t].y)]++;
+    for (int r=0; r<rock_count; r++) prop_start[grid_cell(rocks[r].x, rocks[r].y)]++;
+    for (int c=1; c<=GRID_CELLS; c++) prop_start[c] += prop_start[c-1];
+    // placing from the back of each cell: rocks first, then trees top down
+    for (int r=rock_count-1; r>=0; r--) prop_items[--prop_start[grid_cell(rocks[r].x, rocks[r].y)]] = ~r;
+    for (int t=tree_count-1; t>=0; t--) prop_items[--prop_start[grid_cell(trees[t].x, trees[t].y)]] = t;
+}
 
-                case PROP_WIRE:
-                    // wire doesn't block bullets
+/**
+ * Lowest index standing tree the bullet at (x, y) hits, as a full scan in
+ * index order would find, or -1
+ */
+static int grid_tree_hit(num x, num y) {
+    int col = grid_col(x);
+    int row = grid_row(y);
+    int hit = -1;
+    for (int r=row-1; r<=row+1; r++) {
+        if (r < 0 || r >= GRID_ROWS) continue;
+        for (int c=col-1; c<=col+1; c++) {
+            if (c < 0 || c >= GRID_COLS) continue;
+            int cell = r*GRID_COLS + c;
+            for (int k=prop_start[cell]; k<prop_start[cell+1]; k++) {
+                int t = prop_items[k];
+                if (t < 0 || (hit >= 0 && t > hit)) break; // rocks from here on
+                if (!trees[t].alive) continue;
+                // tree radius ~12, bullet ~2
+                if (circle_hit(trees[t].x, trees[t].y, NUM(12.0f), x, y, NUM(2.0f))) {
+                    hit = t;
                     break;
+                }
             }
         }
     }
+    return hit;
+}
 
-    // player vs wire
-    if (player.alive) {
-        for (int p=0; p<prop_count; p++) {
-            if (!props[p].alive) continue;
-            if (props[p].kind != PROP_WIRE) continue;
-
-            // wire radius ~10, player radius ~10
-            if (circle_hit(props[p].x, props[p].y, 10.0f, player.x, player.y, 10.0f)) {
-                player.alive = false;
-                break;
-            }
-        }
-    }
-
-    // enemies vs wire
-    for (int e=0; e<MAX_ENEMIES; e++) {
-        Enemy *en = &enemies[e];
-        if (!en->alive) continue;
-
-        for (int p=0; p<prop_count; p++) {
-            if (!props[p].alive) continue;
-            if (props[p].kind != PROP_WIRE) continue;
-
-            // enemy radius ~10
-            if (circle_hit(props[p].x, props[p].y, 10.0f, en->x, en->y, 10.0f)) {
-                en->alive = false;
-                en->death_timer = ENEMY_DEATH_TIME_SEC;
-                break;
+static bool grid_rock_hit(num x, num y) {
+    int col = grid_col(x);
+    int row = grid_row(y);
+    for (int r=row-1; r<=row+1; r++) {
+        if (r < 0 || r >= GRID_ROWS) continue;
+        for (int c=col-1; c<=col+1; c++) {
+            if (c < 0 || c >= GRID_COLS) continue;
+            int cell = r*GRID_COLS + c;
+            for (int k=prop_start[cell+1]-1; k>=prop_start[cell] && prop_items[k] < 0; k--) {
+                const PropSpot *rock = &rocks[~prop_items[k]];
+                // rock radius ~10
+                if (circle_hit(rock->x, rock->y, NUM(10.0f), x, y, NUM(2.0f))) return true;
             }
         }
     }
+    return false;
 }
 
 /**
- * Bullets hitting actors
+ * Add battlefield props
  */
-static void handle_bullet_actor_collisions(void) {
-    for (int b=0; b<MAX_BULLETS; b++) {
-        if (!bullets[b].alive) continue;
+static void generate_props(void) {
+    tree_count = rock_count = wire_count = 0;
+    memset(wire_bitmap, 0, sizeof(uint32_t) * WIRE_WORDS * SCREEN_H);
+    for (int i=0; i<prop_cap; i++) {
+        num r = frand01();
+        PropType k;
+        if (r < NUM(0.8f))      k = PROP_TREE;
+        else if (r < NUM(0.9f)) k = PROP_ROCK;
+        else                    k = PROP_WIRE;
 
-        if (!bullets[b].from_enemy) {
-            // player bullet vs enemy
-            for (int e=0; e<MAX_ENEMIES; e++) {
-                Enemy *en = &enemies[e];
-                if (!en->alive) continue;
-
-                if (circle_hit(bullets[b].x, bullets[b].y, 2.0f, en->x, en->y, 10.0f)) {
-                    en->alive = false;
-                    en->death_timer = ENEMY_DEATH_TIME_SEC;
-                    bullets[b].alive = false;
-                    break;
-                }
+        num x = frand_range(NUM(30.0f), NUM(SCREEN_W - 30.0f));
+        num y = frand_range(NUM(30.0f), NUM(SCREEN_H - 30.0f));
+
+        // avoid spawn zone
+        num2 d2c = dist2(x, y, NUM(SCREEN_W/2.0f), NUM(SCREEN_H/2.0f));
+        if (d2c < num_sq(NUM(100.0f))) {
+            i--;
+            continue;
+        }
+
+        // one packed array per kind
+        switch (k) {
+            case PROP_TREE:
+                trees[tree_count].x = x;
+                trees[tree_count].y = y;
+                trees[tree_count].alive = true;
+                tree_count++;
+                break;
+            case PROP_ROCK:
+                rocks[rock_count].x = x;
+                rocks[rock_count].y = y;
+                rock_count++;
+                break;
+            case PROP_WIRE:
+                wires[wire_count].x = x;
+                wires[wire_count].y = y;
+                wire_count++;
+                rasterize_wire(x, y);
+                break;
+        }
+    }
+    prop_grid_build();
+}
+
+/**
+ * Reset the game
+ */
+static void reset_game(void) {
+    release_round();
+    if (!alloc_round()) {
+        SDL_Log("cannot allocate %d bullets, %d enemies and %d props, using defaults",
+            bullet_cap, enemy_cap, prop_cap);
+        bullet_cap = MAX_BULLETS;
+        enemy_cap = MAX_ENEMIES;
+        prop_cap = MAX_PROPS;
+        if (!alloc_round()) {
+            SDL_Log("out of memory");
+            exit(1);
+        }
+    }
+    scale_horde();
+
+    for (int p=0; p<MAX_PLAYERS; p++) {
+        Player *pl = &players[p];
+        pl->x = NUM(SCREEN_W/2.0f);
+        pl->y = NUM(SCREEN_H/2.0f);
+        if (player_count > 1) pl->x += p ? NUM(20.0f) : NUM(-20.0f); // side by side
+        pl->aimx = 0;
+        pl->aimy = NUM(-1.0f);
+        pl->shoot_cooldown = 0;
+        pl->alive = p < player_count;
+    }
+
+    memset(bullet_flags, 0, sizeof(uint8_t) * bullet_cap);
+    memset(enemy_flags, 0, sizeof(uint8_t) * enemy_cap);
+
+    pool_reset(&bullet_pool, bullet_cap);
+    pool_reset(&enemy_pool, enemy_cap);
+
+    round_id++;
+    round_seed = rng_state;
+    generate_dots();
+    generate_props();
+
+    survival_time = 0;
+    timer_reset();
+    timer_schedule(TIMER_SPAWN, TIMER_SPAWN_WAVE, 0); // first spawn right away
+    game_over = false;
+    game_won = false;
+    if(show_welcome_msg) {
+        paused = true;
+    } else {
+        paused = false;
+    }
+}
+
+/**
+ * Particles
+ * Purely cosmetic effects in structure-of-arrays storage. Emitters write at
+ * the head of a fixed ring, overwriting the oldest particles when it is full;
+ * since particles age in ring order, culling only has to move the tail past
+ * the dead ones. The update runs four particles per step on the vector
+ * extensions. Emitters draw from their own generator and stay quiet while
+ * rollback replays ticks, so effects never touch the simulation.
+ */
+static const Emitter fx_muzzle = { 6, 60.0f, 180.0f, 0.06f, 0.16f, 0.35f, { 0xFFFFE890u, 0xFFFFA040u } };
+static const Emitter fx_sparks = { 5, 40.0f, 120.0f, 0.10f, 0.25f, 1.20f, { 0xFFD0D0C8u, 0xFF8A8A84u } };
+static const Emitter fx_debris = { 16, 30.0f, 140.0f, 0.40f, 0.90f, 3.1416f, { 0xFF4A6A30u, 0xFF5A3A22u } };
+static const Emitter fx_blood  = { 12, 40.0f, 120.0f, 0.25f, 0.60f, 3.1416f, { 0xFF8C0000u, 0xFFB01010u } };
+
+static bool particles_init(void) {
+    float *f = calloc((size_t)PARTICLE_CAP * 6, sizeof(float));
+    fx.color = calloc(PARTICLE_CAP, sizeof(uint32_t));
+    fx.verts = malloc(sizeof(SDL_Vertex) * 4 * PARTICLE_CAP);
+    fx.indices = malloc(sizeof(int) * 6 * PARTICLE_CAP);
+    if (!f || !fx.color || !fx.verts || !fx.indices) {
+        free(f);
+        free(fx.color);
+        free(fx.verts);
+        free(fx.indices);
+        memset(&fx, 0, sizeof(fx));
+        return false;
+    }
+    fx.x = f;
+    fx.y = f + PARTICLE_CAP;
+    fx.vx = f + 2*PARTICLE_CAP;
+    fx.vy = f + 3*PARTICLE_CAP;
+    fx.life = f + 4*PARTICLE_CAP;
+    fx.fade = f + 5*PARTICLE_CAP;
+    for (int i=0; i<PARTICLE_CAP; i++) {
+        static const int quad[6] = { 0, 1, 2, 2, 1, 3 };
+        for (int k=0; k<6; k++) fx.indices[6*i+k] = 4*i + quad[k];
+    }
+    fx.rng = 0x5EED0F1A5EED0F1AULL;
+    return true;
+}
+
+static void particles_free(void) {
+    free(fx.x);
+    free(fx.color);
+    free(fx.verts);
+    free(fx.indices);
+    memset(&fx, 0, sizeof(fx));
+}
+
+static float fx_rand(float a, float b) {
+    return a + (float)(xorshift64s(&fx.rng) >> 8) / 16777216.0f * (b-a);
+}
+
+static void emit(const Emitter *em, num x, num y, num dx, num dy) {
+#ifdef TOMMY_SIM_THREAD
+    if (on_sim_worker) {
+        // particles live on the main thread, which plays these when it collects the step
+        if (sim.emit_count < SIM_EMIT_QUEUE) sim.emits[sim.emit_count++] = (EmitRequest){ em, x, y, dx, dy };
+        return;
+    }
+#endif
+    if (!fx.x || resimulating) return;
+    float px = num_to_float(x);
+    float py = num_to_float(y);
+    float heading = atan2f(num_to_float(dy), num_to_float(dx));
+    for (int k=0; k<em->count; k++) {
+        if (fx.head - fx.tail == PARTICLE_CAP) fx.tail++; // full: drop the oldest
+        uint32_t s = fx.head++ & (PARTICLE_CAP-1);
+        float a = heading + fx_rand(-em->spread, em->spread);
+        float v = fx_rand(em->speed_min, em->speed_max);
+        float life = fx_rand(em->life_min, em->life_max);
+        fx.x[s] = px;
+        fx.y[s] = py;
+        fx.vx[s] = cosf(a) * v;
+        fx.vy[s] = sinf(a) * v;
+        fx.life[s] = life;
+        fx.fade[s] = 1.0f / life;
+        fx.color[s] = em->colors[xorshift64s(&fx.rng) & 1];
+    }
+}
+
+static void particles_update(float dt) {
+    if (!fx.x) return;
+    // aligned groups of four covering the live window; slots around it are dead
+    uint32_t first = fx.tail & ~3u;
+    uint32_t n = (fx.head - first + 3) & ~3u;
+    if (n > PARTICLE_CAP - 4) {
+        first = 0;
+        n = PARTICLE_CAP;
+    }
+    f32x4 step = { dt, dt, dt, dt };
+    float k = 1.0f - PARTICLE_DRAG * dt;
+    if (k < 0.0f) k = 0.0f;
+    f32x4 drag = { k, k, k, k };
+    i32x4 live = { 0, 0, 0, 0 };
+    for (uint32_t i=0; i<n; i+=4) {
+        uint32_t s = (first + i) & (PARTICLE_CAP-1);
+        f32x4 x, y, vx, vy, life;
+        memcpy(&x, fx.x+s, sizeof x);
+        memcpy(&y, fx.y+s, sizeof y);
+        memcpy(&vx, fx.vx+s, sizeof vx);
+        memcpy(&vy, fx.vy+s, sizeof vy);
+        memcpy(&life, fx.life+s, sizeof life);
+        x += vx * step;
+        y += vy * step;
+        vx *= drag;
+        vy *= drag;
+        life -= step;
+        live -= (i32x4)(life > 0.0f); // true lanes are -1
+        memcpy(fx.x+s, &x, sizeof x);
+        memcpy(fx.y+s, &y, sizeof y);
+        memcpy(fx.vx+s, &vx, sizeof vx);
+        memcpy(fx.vy+s, &vy, sizeof vy);
+        memcpy(fx.life+s, &life, sizeof life);
+    }
+    fx.live = live[0] + live[1] + live[2] + live[3];
+    while (fx.tail != fx.head && fx.life[fx.tail & (PARTICLE_CAP-1)] <= 0.0f) fx.tail++;
+}
+
+/**
+ * Spawn bullet
+ */
+static void spawn_bullet(num x, num y, num dx, num dy, num speed, bool from_enemy) {
+    int i = pool_take(&bullet_pool);
+    if (i < 0) return;
+    normalize(&dx,&dy);
+    bullets[i].x = x;
+    bullets[i].y = y;
+    bullets[i].vx = num_mul(dx, speed);
+    bullets[i].vy = num_mul(dy, speed);
+    bullet_flags[i] = BULLET_ALIVE | (from_enemy ? BULLET_FROM_ENEMY : 0);
+    emit(&fx_muzzle, x, y, dx, dy);
+}
+
+/**
+ * Remove bullet
+ */
+static void kill_bullet(int i) {
+    bullet_flags[i] = 0;
+    pool_release(&bullet_pool, i);
+}
+
+/**
+ * Let player fire
+ */
+static void try_player_fire(Player *pl) {
+    if (!pl->alive) return;
+    if (pl->shoot_cooldown > 0) return;
+
+    num dx = pl->aimx;
+    num dy = pl->aimy;
+    if (num_abs(dx) < NUM(0.0001f) && num_abs(dy) < NUM(0.0001f)) {
+        dx = 0; dy = NUM(-1.0f);
+    }
+
+    spawn_bullet(pl->x, pl->y, dx, dy, NUM(BULLET_SPEED), false);
+    pl->shoot_cooldown = NUM(PLAYER_SHOOT_COOLDOWN_SEC);
+}
+
+/**
+ * Let enemy fire
+ */
+static void enemy_try_fire(int i) {
+    Enemy *e = &enemies[i];
+    if (!(enemy_flags[i] & ENEMY_ALIVE)) return;
+    if (!(enemy_flags[i] & ENEMY_CAN_FIRE)) return;
+    Player *target = nearest_player(e->x, e->y);
+    if (!target) return;
+
+    num dx = target->x - e->x;
+    num dy = target->y - e->y;
+    num2 d2p = dist2(target->x, target->y, e->x, e->y);
+    if (d2p > num_sq(NUM(250.0f))) {
+        return;
+    }
+
+    spawn_bullet(e->x, e->y, dx, dy, NUM(ENEMY_BULLET_SPEED), true);
+    enemy_flags[i] &= ~ENEMY_CAN_FIRE;
+    timer_schedule(ENEMY_TIMER(i), TIMER_ENEMY_FIRE, NUM(ENEMY_FIRE_COOLDOWN_SEC));
+}
+
+/**
+ * Kill enemy, leaving its blood on the ground for a moment
+ */
+static void kill_enemy(int i) {
+    // blood sprays all round, headed the way the enemy was charging
+    Enemy *e = &enemies[i];
+    Player *target = nearest_player(e->x, e->y);
+    num dx = target ? target->x - e->x : 0;
+    num dy = target ? target->y - e->y : 0;
+    emit(&fx_blood, e->x, e->y, dx, dy);
+    enemy_flags[i] = ENEMY_DYING;
+    timer_schedule(ENEMY_TIMER(i), TIMER_ENEMY_DEATH, NUM(ENEMY_DEATH_TIME_SEC));
+}
+
+/**
+ * Spawn enemies
+ */
+static void spawn_enemy(int edge) {
+    int idx = pool_take(&enemy_pool);
+    if (idx < 0) return;
+
+    if (edge < 0) edge = rng_next()%4;
+    num x,y;
+    if (edge==0) { // top
+        x = frand_range(0, NUM_INT(SCREEN_W));
+        y = NUM_INT(-20);
+    } else if (edge==1) { // bottom
+        x = frand_range(0, NUM_INT(SCREEN_W));
+        y = NUM_INT(SCREEN_H + 20);
+    } else if (edge==2) { // left
+        x = NUM_INT(-20);
+        y = frand_range(0, NUM_INT(SCREEN_H));
+    } else { // right
+        x = NUM_INT(SCREEN_W + 20);
+        y = frand_range(0, NUM_INT(SCREEN_H));
+    }
+
+    enemies[idx].x = x;
+    enemies[idx].y = y;
+    enemy_flags[idx] = ENEMY_ALIVE;
+    timer_schedule(ENEMY_TIMER(idx), TIMER_ENEMY_FIRE, NUM(ENEMY_FIRE_COOLDOWN_SEC));
+}
+
+/**
+ * Wave scheduler
+ * Runs on each spawn event: spawns for the wave in progress and schedules the
+ * next event according to that wave's pacing.
+ */
+static void run_wave(void) {
+    int w = 0;
+    while (w+1 < scenario->wave_count && scenario->waves[w+1].start <= survival_time) w++;
+    const Wave *wave = &scenario->waves[w];
+
+    num interval = wave->interval;
+    if (wave->kind == WAVE_RAMP) {
+        num end = w+1 < scenario->wave_count ? scenario->waves[w+1].start : win_time;
+        num t = num_div(survival_time - wave->start, end - wave->start);
+        if (t > NUM_ONE) t = NUM_ONE;
+        interval = wave->interval + num_mul(wave->interval_end - wave->interval, t);
+    }
+
+    // the horde grows with the enemy capacity, rounded in integers
+    int count = wave->count;
+    if (enemy_cap > MAX_ENEMIES) {
+        count = (int)(((int64_t)wave->count * enemy_cap + MAX_ENEMIES/2) / MAX_ENEMIES);
+    }
+    int edge = wave->kind == WAVE_BURST ? (int)(rng_next()%4) : -1;
+    for (int i=0; i<count; i++) {
+        spawn_enemy(edge);
+    }
+    timer_schedule(TIMER_SPAWN, TIMER_SPAWN_WAVE, interval);
+}
+
+/**
+ * Advance the timer wheel, firing whatever expires along the way
+ */
+static void advance_timers(num dt) {
+    wheel.accum += dt;
+    while (wheel.accum >= NUM(1.0f/TIMER_HZ)) {
+        wheel.accum -= NUM(1.0f/TIMER_HZ);
+        wheel.now++;
+
+        // level 0 wrapped: pull the next level 1 bucket down
+        if ((wheel.now & (WHEEL_SLOTS-1)) == 0) {
+            int *bucket = &wheel.heads[1][(wheel.now >> WHEEL_BITS) & (WHEEL_SLOTS-1)];
+            int id = *bucket;
+            *bucket = -1;
+            while (id >= 0) {
+                int next = timers[id].next;
+                timer_link(id);
+                id = next;
             }
-        } else {
-            // enemy bullet vs player
-            if (player.alive) {
-                if (circle_hit(bullets[b].x, bullets[b].y, 2.0f, player.x, player.y, 10.0f)) {
-                    player.alive = false;
-                    bullets[b].alive = false;
-                }
+        }
+
+        int *slot = &wheel.heads[0][wheel.now & (WHEEL_SLOTS-1)];
+        while (*slot >= 0) {
+            int id = *slot;
+            TimerKind kind = timers[id].kind;
+            timer_cancel(id);
+            switch (kind) {
+                case TIMER_ENEMY_FIRE:
+                    enemy_flags[id-1] |= ENEMY_CAN_FIRE;
+                    break;
+                case TIMER_ENEMY_DEATH:
+                    enemy_flags[id-1] = 0;
+                    pool_release(&enemy_pool, id-1);
+                    break;
+                case TIMER_SPAWN_WAVE:
+                    run_wave();
+                    break;
+                case TIMER_NONE:
+                    break;
             }
         }
     }
 }
 
 /**
- * Draws a rectangle at exact start and end coordinates
+ * Read the keyboard into input bits
  */
-static void draw_rect(SDL_Renderer *ren, int x, int y, int w, int h) {
-    SDL_Rect r = { x, y, w, h };
-    SDL_RenderFillRect(ren, &r);
+static InputBits input_from_keys(const Uint8 *keys) {
+    InputBits in = 0;
+    if (keys[SDL_SCANCODE_W]) in |= INPUT_MOVE_UP;
+    if (keys[SDL_SCANCODE_S]) in |= INPUT_MOVE_DOWN;
+    if (keys[SDL_SCANCODE_A]) in |= INPUT_MOVE_LEFT;
+    if (keys[SDL_SCANCODE_D]) in |= INPUT_MOVE_RIGHT;
+    if (keys[SDL_SCANCODE_I]) in |= INPUT_FIRE_UP;
+    if (keys[SDL_SCANCODE_K]) in |= INPUT_FIRE_DOWN;
+    if (keys[SDL_SCANCODE_J]) in |= INPUT_FIRE_LEFT;
+    if (keys[SDL_SCANCODE_L]) in |= INPUT_FIRE_RIGHT;
+    if (keys[SDL_SCANCODE_SPACE]) in |= INPUT_RESTART;
+    return in;
 }
 
 /**
- * Draws a rectangle using starting coordinates and scale
+ * Bot autopilot
+ * Plays a player through the same input bits as the keyboard. Bots draw from
+ * their own generator, so they never disturb the simulation's random stream
+ * and a given --seed replays the same run.
  */
-static void draw_rect_scaled(SDL_Renderer *ren, int x, int y, int s) {
-    SDL_Rect r = { x, y, s, s };
-    SDL_RenderFillRect(ren, &r);
+static uint64_t bot_rng_state = 1;
+static BotState bot_states[MAX_PLAYERS];
+
+static const InputBits bot_headings[8] = {
+    INPUT_MOVE_UP, INPUT_MOVE_UP | INPUT_MOVE_RIGHT, INPUT_MOVE_RIGHT,
+    INPUT_MOVE_DOWN | INPUT_MOVE_RIGHT, INPUT_MOVE_DOWN, INPUT_MOVE_DOWN | INPUT_MOVE_LEFT,
+    INPUT_MOVE_LEFT, INPUT_MOVE_UP | INPUT_MOVE_LEFT
+};
+
+static void bot_seed(uint64_t seed) {
+    bot_rng_state = (seed ^ 0xB07B07B07B07B07BULL) * 0x9E3779B97F4A7C15ULL;
+    if (bot_rng_state == 0) bot_rng_state = 1;
+    for (int p=0; p<MAX_PLAYERS; p++) {
+        bot_states[p].move = 0;
+        bot_states[p].hold = 0;
+        bot_states[p].strafe = 1;
+    }
+}
+
+static uint32_t bot_rand(void) {
+    return xorshift64s(&bot_rng_state);
+}
+
+static void heading_vector(InputBits in, num *x, num *y) {
+    *x = 0;
+    *y = 0;
+    if (in & INPUT_MOVE_UP)    *y -= NUM_ONE;
+    if (in & INPUT_MOVE_DOWN)  *y += NUM_ONE;
+    if (in & INPUT_MOVE_LEFT)  *x -= NUM_ONE;
+    if (in & INPUT_MOVE_RIGHT) *x += NUM_ONE;
+    normalize(x, y);
+}
+
+// nearest of the eight headings, 0 for a zero vector
+static InputBits bot_heading(num dx, num dy) {
+    normalize(&dx, &dy);
+    InputBits in = 0;
+    if (dy < NUM(-0.38f)) in |= INPUT_MOVE_UP;
+    if (dy > NUM( 0.38f)) in |= INPUT_MOVE_DOWN;
+    if (dx < NUM(-0.38f)) in |= INPUT_MOVE_LEFT;
+    if (dx > NUM( 0.38f)) in |= INPUT_MOVE_RIGHT;
+    return in;
+}
+
+// fire along the axis closest to the target
+static InputBits bot_aim(num dx, num dy) {
+    if (num_abs(dx) > num_abs(dy)) return dx < 0 ? INPUT_FIRE_LEFT : INPUT_FIRE_RIGHT;
+    return dy < 0 ? INPUT_FIRE_UP : INPUT_FIRE_DOWN;
+}
+
+static bool bot_nearest_enemy(const Player *pl, num *dx, num *dy) {
+    bool found = false;
+    num2 best = 0;
+    for (int e=0; e<enemy_pool.hi; e++) {
+        if (!(enemy_flags[e] & ENEMY_ALIVE)) continue;
+        num2 d = dist2(pl->x, pl->y, enemies[e].x, enemies[e].y);
+        if (!found || d < best) {
+            found = true;
+            best = d;
+            *dx = enemies[e].x - pl->x;
+            *dy = enemies[e].y - pl->y;
+        }
+    }
+    return found;
+}
+
+// sidestep the enemy bullet that will pass closest soon, if any
+static bool bot_dodge(const Player *pl, num *mx, num *my) {
+    num2 worst = num_sq(NUM(24.0f));
+    bool found = false;
+    for (int b=0; b<bullet_pool.hi; b++) {
+        if ((bullet_flags[b] & (BULLET_ALIVE|BULLET_FROM_ENEMY)) != (BULLET_ALIVE|BULLET_FROM_ENEMY)) continue;
+        const Bullet *bl = &bullets[b];
+        num ux = bl->vx;
+        num uy = bl->vy;
+        num speed = length(ux, uy);
+        if (speed <= 0) continue;
+        normalize(&ux, &uy);
+        num rx = pl->x - bl->x;
+        num ry = pl->y - bl->y;
+        num along = num_mul(rx, ux) + num_mul(ry, uy); // distance to closest approach
+        if (along < 0 || along > num_mul(speed, NUM(0.6f))) continue;
+        num ax = rx - num_mul(ux, along);
+        num ay = ry - num_mul(uy, along);
+        num2 miss = num_sq(ax) + num_sq(ay);
+        if (miss < worst) {
+            worst = miss;
+            found = true;
+            // move further out along the miss vector, or sideways on a dead hit
+            if (miss > num_sq(NUM_ONE)) {
+                *mx = ax;
+                *my = ay;
+            } else {
+                *mx = -uy;
+                *my = ux;
+            }
+        }
+    }
+    return found;
+}
+
+// turn away from wire ahead, trying the closest headings first
+static InputBits bot_avoid_wire(const Player *pl, InputBits move) {
+    int h = 0;
+    while (h < 8 && bot_headings[h] != move) h++;
+    if (h == 8) return move;
+    for (int k=0; k<8; k++) {
+        int turn = (k+1)/2 * (k % 2 ? 1 : -1);
+        InputBits m = bot_headings[(h + turn + 8) % 8];
+        num vx, vy;
+        heading_vector(m, &vx, &vy);
+        bool clear = true;
+        for (num r=NUM(BOT_PROBE/4); r<=NUM(BOT_PROBE) && clear; r+=NUM(BOT_PROBE/4)) {
+            clear = !touches_wire(pl->x + num_mul(vx, r), pl->y + num_mul(vy, r));
+        }
+        if (clear) return m;
+    }
+    return 0;
+}
+
+static InputBits bot_random_walk(const Player *pl, BotState *st) {
+    if (--st->hold <= 0) {
+        uint32_t r = bot_rand();
+        st->move = r % 9 < 8 ? bot_headings[r % 9] : 0;
+        st->hold = 20 + (int)((r >> 8) % 60);
+    }
+    st->move = bot_avoid_wire(pl, st->move);
+    InputBits in = st->move;
+    uint32_t r = bot_rand();
+    if (r & 1) in |= (InputBits)(INPUT_FIRE_UP << ((r >> 1) % 4));
+    return in;
+}
+
+static InputBits bot_kite(const Player *pl, BotState *st) {
+    num dx = NUM(SCREEN_W/2.0f) - pl->x;
+    num dy = NUM(SCREEN_H/2.0f) - pl->y;
+    num mx = dx;
+    num my = dy;
+    InputBits fire = 0;
+    if (bot_nearest_enemy(pl, &dx, &dy)) {
+        num d = length(dx, dy);
+        if (bot_rand() % 120 == 0) st->strafe = -st->strafe;
+        // back off when close, close in when far, circle in between
+        mx = -dy * st->strafe;
+        my = dx * st->strafe;
+        if (d < NUM(BOT_KITE_NEAR)) {
+            mx -= dx;
+            my -= dy;
+        } else if (d > NUM(BOT_KITE_FAR)) {
+            mx += dx;
+            my += dy;
+        }
+        fire = bot_aim(dx, dy);
+    }
+    bot_dodge(pl, &mx, &my);
+    // stay off the edges, where kiting gets cornered
+    num edge = NUM(80.0f);
+    if (pl->x < edge) mx += edge;
+    if (pl->x > NUM_INT(SCREEN_W)-edge) mx -= edge;
+    if (pl->y < edge) my += edge;
+    if (pl->y > NUM_INT(SCREEN_H)-edge) my -= edge;
+    return bot_avoid_wire(pl, bot_heading(mx, my)) | fire;
+}
+
+static InputBits bot_stand_still(const Player *pl, BotState *st) {
+    (void)st;
+    num dx, dy;
+    if (bot_nearest_enemy(pl, &dx, &dy)) return bot_aim(dx, dy);
+    return 0;
+}
+
+static const BotPolicy bot_policies[] = {
+    { "walk",  bot_random_walk },
+    { "kite",  bot_kite },
+    { "still", bot_stand_still },
+};
+static const BotPolicy *bot = NULL;
+
+static InputBits bot_input(int p) {
+    return bot->think(&players[p], &bot_states[p]);
 }
 
 /**
- * Draws a circle
+ * Player controls
  */
-static void draw_filled_circle(SDL_Renderer *ren, int cx, int cy, int r) {
-    for (int dy=-r; dy<=r; dy++) {
-        for (int dx=-r; dx<=r; dx++) {
-            if (dx*dx + dy*dy <= r*r) {
-                SDL_RenderDrawPoint(ren, cx+dx, cy+dy);
-            }
+static void control_player(Player *pl, num dt, InputBits in) {
+    if (!pl->alive) return;
+
+    // W A S D to move
+    num mx = 0;
+    num my = 0;
+    if (in & INPUT_MOVE_UP)    my -= NUM_ONE;
+    if (in & INPUT_MOVE_DOWN)  my += NUM_ONE;
+    if (in & INPUT_MOVE_LEFT)  mx -= NUM_ONE;
+    if (in & INPUT_MOVE_RIGHT) mx += NUM_ONE;
+
+    num mvx = mx;
+    num mvy = my;
+    normalize(&mvx,&mvy);
+
+    pl->x += num_mul(num_mul(mvx, NUM(PLAYER_SPEED)), dt);
+    pl->y += num_mul(num_mul(mvy, NUM(PLAYER_SPEED)), dt);
+
+    // clamp to map
+    if (pl->x < NUM_INT(10)) pl->x = NUM_INT(10);
+    if (pl->x > NUM_INT(SCREEN_W-10)) pl->x = NUM_INT(SCREEN_W-10);
+    if (pl->y < NUM_INT(10)) pl->y = NUM_INT(10);
+    if (pl->y > NUM_INT(SCREEN_H-10)) pl->y = NUM_INT(SCREEN_H-10);
+
+    // I J K L to aim and fire
+    num ax = 0;
+    num ay = 0;
+    bool aiming_now = false;
+
+    if (in & INPUT_FIRE_UP)    { ay -= NUM_ONE; aiming_now = true; }
+    if (in & INPUT_FIRE_DOWN)  { ay += NUM_ONE; aiming_now = true; }
+    if (in & INPUT_FIRE_LEFT)  { ax -= NUM_ONE; aiming_now = true; }
+    if (in & INPUT_FIRE_RIGHT) { ax += NUM_ONE; aiming_now = true; }
+
+    if (aiming_now) {
+        pl->aimx = ax;
+        pl->aimy = ay;
+        normalize(&pl->aimx, &pl->aimy);
+        try_player_fire(pl);
+    }
+
+    if (pl->shoot_cooldown > 0) {
+        pl->shoot_cooldown -= dt;
+        if (pl->shoot_cooldown < 0) pl->shoot_cooldown = 0;
+    }
+}
+
+/**
+ * Move bullets
+ * Only the movement and bounds check are vector code. The hit tests stay
+ * scalar: they go through the neighbour and prop grids, which leave each
+ * bullet a handful of gathered candidates and need the lowest index hit.
+ */
+static void move_bullets(num dt) {
+#if NUM_FRAC_BITS
+    for (int i=0;i<bullet_pool.hi;i++) {
+        if (!(bullet_flags[i] & BULLET_ALIVE)) continue;
+        bullets[i].x += num_mul(bullets[i].vx, dt);
+        bullets[i].y += num_mul(bullets[i].vy, dt);
+
+        if (bullets[i].x < NUM_INT(-50) || bullets[i].x > NUM_INT(SCREEN_W+50) ||
+            bullets[i].y < NUM_INT(-50) || bullets[i].y > NUM_INT(SCREEN_H+50)) {
+            kill_bullet(i);
         }
     }
+#else
+    // a float bullet is one vector { x, y, vx, vy }: the position lanes gain
+    // velocity * dt and the velocity lanes velocity * 0, which keeps them bit
+    // for bit, and one compare checks both bounds
+    f32x4 step = { dt, dt, 0.0f, 0.0f };
+    f32x4 lo = { -50.0f, -50.0f, -INFINITY, -INFINITY };
+    f32x4 hi = { SCREEN_W+50.0f, SCREEN_H+50.0f, INFINITY, INFINITY };
+    for (int i=0;i<bullet_pool.hi;i++) {
+        if (!(bullet_flags[i] & BULLET_ALIVE)) continue;
+        f32x4 b;
+        memcpy(&b, &bullets[i], sizeof(b));
+        f32x4 v = { b[2], b[3], b[2], b[3] };
+        f32x4 d = v * step;
+        b += d;
+        memcpy(&bullets[i], &b, sizeof(b));
+        i32x4 out = (i32x4)(b < lo) | (i32x4)(b > hi);
+        if (out[0] | out[1]) kill_bullet(i);
+    }
+#endif
+
+    // stop walking the dead tail
+    while (bullet_pool.hi > 0 && !(bullet_flags[bullet_pool.hi-1] & BULLET_ALIVE)) bullet_pool.hi--;
 }
 
 /**
- * Draws a soldier
+ * Enemy neighbour grid
+ * A uniform grid over the battlefield and a margin around it, filled with a
+ * counting sort of the live enemies: one pass to count per cell, a prefix
+ * sum, and one pass to place. Placing walks the enemies from the top down,
+ * so each cell lists its enemies in ascending index order and every query
+ * visits them in the same order on every run. Cells are bigger than any
+ * query radius, so a query only looks at the 3x3 cells around its point.
  */
-static void draw_soldier(SDL_Renderer *ren, int x, int y, bool player_flag) {
-    // outline
-    SDL_SetRenderDrawColor(ren, 20, 15, 10, 255);
-    draw_rect(ren, x-9, y-9, 18,18);
+static void grid_build(void) {
+    memset(grid_start, 0, sizeof(int) * (GRID_CELLS+1));
+    for (int i=0; i<enemy_pool.hi; i++) {
+        if (!(enemy_flags[i] & ENEMY_ALIVE)) continue;
+        int c = grid_cell(enemies[i].x, enemies[i].y);
+        grid_cells[i] = c;
+        grid_start[c]++;
+    }
+    // running totals: grid_start[c] is now one past the end of cell c
+    for (int c=1; c<=GRID_CELLS; c++) grid_start[c] += grid_start[c-1];
+    for (int i=enemy_pool.hi-1; i>=0; i--) {
+        if (!(enemy_flags[i] & ENEMY_ALIVE)) continue;
+        grid_items[--grid_start[grid_cells[i]]] = i;
+    }
+}
 
-    // coat / body
-    if (player_flag) {
-    	SDL_SetRenderDrawColor(ren, 110, 90, 50, 255);
-    } else {
-    	SDL_SetRenderDrawColor(ren, 80, 100, 80, 255);
+/**
+ * Push apart from the live enemies closer than ENEMY_SEPARATION, harder the
+ * deeper the overlap. Only the first ENEMY_SEPARATION_MAX found count: deep
+ * in a siege pile a few already point the way out, and the scan stops there
+ * instead of walking every enemy in the nine cells. The enemy's own cell is
+ * searched first, so a capped push does not lean towards one side.
+ */
+static void separation(int i, num *sx, num *sy) {
+    static const int around[9][2] = {
+        {0,0}, {-1,-1}, {0,-1}, {1,-1}, {-1,0}, {1,0}, {-1,1}, {0,1}, {1,1}
+    };
+    const Enemy *e = &enemies[i];
+    int col = grid_col(e->x);
+    int row = grid_row(e->y);
+    int found = 0;
+    *sx = 0;
+    *sy = 0;
+    for (int n=0; n<9 && found<ENEMY_SEPARATION_MAX; n++) {
+        int c = col + around[n][0];
+        int r = row + around[n][1];
+        if (c < 0 || c >= GRID_COLS || r < 0 || r >= GRID_ROWS) continue;
+        int cell = r*GRID_COLS + c;
+        for (int k=grid_start[cell]; k<grid_start[cell+1] && found<ENEMY_SEPARATION_MAX; k++) {
+            int j = grid_items[k];
+            if (j == i || !(enemy_flags[j] & ENEMY_ALIVE)) continue;
+            num ox = e->x - enemies[j].x;
+            num oy = e->y - enemies[j].y;
+            if (num_sq(ox) + num_sq(oy) >= num_sq(NUM(ENEMY_SEPARATION))) continue;
+            num d = length(ox, oy);
+            if (d <= 0) {
+                // exactly stacked: split them by index
+                ox = j < i ? NUM_ONE : -NUM_ONE;
+                oy = 0;
+                d = NUM_ONE;
+            }
+            // overlap depth as a fraction of the range, over d to normalise the offset
+            num w = num_div(NUM(ENEMY_SEPARATION) - d, num_mul(NUM(ENEMY_SEPARATION), d));
+            *sx += num_mul(ox, w);
+            *sy += num_mul(oy, w);
+            found++;
+        }
     }
-    draw_rect(ren, x-8, y-8, 16,14);
+}
 
-    // boots / lower
-    if (player_flag) {
-    	SDL_SetRenderDrawColor(ren, 70, 50, 30, 255);
-    } else {
-    	SDL_SetRenderDrawColor(ren, 40, 50, 40, 255);
+/**
+ * Lowest index live enemy the bullet at (x, y) hits, as a full scan in index
+ * order would find, or -1
+ */
+static int grid_bullet_hit(num x, num y) {
+    int col = grid_col(x);
+    int row = grid_row(y);
+    int hit = -1;
+    for (int r=row-1; r<=row+1; r++) {
+        if (r < 0 || r >= GRID_ROWS) continue;
+        for (int c=col-1; c<=col+1; c++) {
+            if (c < 0 || c >= GRID_COLS) continue;
+            int cell = r*GRID_COLS + c;
+            for (int k=grid_start[cell]; k<grid_start[cell+1]; k++) {
+                int e = grid_items[k];
+                if (hit >= 0 && e > hit) break;
+                if (!(enemy_flags[e] & ENEMY_ALIVE)) continue;
+                if (circle_hit(x, y, NUM(2.0f), enemies[e].x, enemies[e].y, NUM(10.0f))) {
+                    hit = e;
+                    break;
+                }
+            }
+        }
     }
-    draw_rect(ren, x-8, y+2, 16,4);
+    return hit;
+}
 
-    // helmet
-    if (player_flag) {
-    	SDL_SetRenderDrawColor(ren, 90, 70, 40, 255);
-    } else {
-    	SDL_SetRenderDrawColor(ren, 60, 80, 60, 255);
+/**
+ * Move enemies
+ */
+static void move_enemies(num dt) {
+    while (enemy_pool.hi > 0 && !(enemy_flags[enemy_pool.hi-1] & (ENEMY_ALIVE|ENEMY_DYING))) {
+        enemy_pool.hi--;
     }
-    draw_rect(ren, x-7, y-12, 14,5);
+    grid_build();
+    for (int i=0;i<enemy_pool.hi;i++) {
+        Enemy *e = &enemies[i];
 
-    // helmet rim highlight
-    if (player_flag) {
-    	SDL_SetRenderDrawColor(ren, 200, 180, 120, 255);
-    } else {
-    	SDL_SetRenderDrawColor(ren, 140, 170, 140, 255);
+        if (enemy_flags[i] & ENEMY_ALIVE) {
+            // chase the nearest player
+            Player *target = nearest_player(e->x, e->y);
+            if (!target) continue;
+            num dx = target->x - e->x;
+            num dy = target->y - e->y;
+            normalize(&dx,&dy);
+
+            // keep some room from the rest of the crowd
+            num sx, sy;
+            separation(i, &sx, &sy);
+            dx += num_mul(sx, NUM(ENEMY_SEPARATION_WEIGHT));
+            dy += num_mul(sy, NUM(ENEMY_SEPARATION_WEIGHT));
+            normalize(&dx,&dy);
+
+            num vx = num_mul(dx, NUM(ENEMY_SPEED));
+            num vy = num_mul(dy, NUM(ENEMY_SPEED));
+            e->x += num_mul(vx, dt);
+            e->y += num_mul(vy, dt);
+
+            // try to shoot
+            enemy_try_fire(i);
+
+            // bayonet melee kill any player
+            for (int p=0; p<player_count; p++) {
+                if (!players[p].alive) continue;
+                num2 d2p = dist2(players[p].x, players[p].y, e->x, e->y);
+                if (d2p < num_sq(NUM(12.0f))) {
+                    players[p].alive = false;
+                }
+            }
+        }
     }
-    draw_rect(ren, x-7, y-12, 14,2);
 }
 
 /**
- * Minimal pixel font
+ * Environment interactions
  */
-static const char *glyph_for_char(char c) {
-    switch (c) {
-    	case ' ': return ".....""....."".....""....."".....";
-        case '.': return "....."".....""....."".##.."".##..";
-        case ',': return "....."".....""....."".##..""..#..";
-        case ':': return ".##.."".##..""....."".##.."".##..";
-        case '-': return "....."".....""#####""....."".....";
+static void handle_props_effects(void) {
+    // bullets vs props, wire doesn't block bullets
+    for (int b=0; b<bullet_pool.hi; b++) {
+        if (!(bullet_flags[b] & BULLET_ALIVE)) continue;
+        num bx = bullets[b].x;
+        num by = bullets[b].y;
+
+        // trees get destroyed by any bullet
+        int t = grid_tree_hit(bx, by);
+        if (t >= 0) {
+            trees[t].alive = false;
+            emit(&fx_debris, trees[t].x, trees[t].y, bullets[b].vx, bullets[b].vy);
+            kill_bullet(b);
+            continue;
+        }
+
+        // rock absorbs bullet
+        if (grid_rock_hit(bx, by)) {
+            emit(&fx_sparks, bx, by, -bullets[b].vx, -bullets[b].vy);
+            kill_bullet(b);
+        }
+    }
+
+    // players vs wire
+    for (int pl=0; pl<player_count; pl++) {
+        if (players[pl].alive && touches_wire(players[pl].x, players[pl].y)) {
+            players[pl].alive = false;
+        }
+    }
+
+    // enemies vs wire
+    for (int e=0; e<enemy_pool.hi; e++) {
+        if ((enemy_flags[e] & ENEMY_ALIVE) && touches_wire(enemies[e].x, enemies[e].y)) {
+            kill_enemy(e);
+        }
+    }
+}
+
+/**
+ * Bullets hitting actors
+ */
+static void handle_bullet_actor_collisions(void) {
+    grid_build(); // enemies have moved since the last build
+    for (int b=0; b<bullet_pool.hi; b++) {
+        if (!(bullet_flags[b] & BULLET_ALIVE)) continue;
+
+        if (!(bullet_flags[b] & BULLET_FROM_ENEMY)) {
+            // player bullet vs enemy
+            int e = grid_bullet_hit(bullets[b].x, bullets[b].y);
+            if (e >= 0) {
+                kill_enemy(e);
+                kill_bullet(b);
+            }
+        } else {
+            // enemy bullet vs players
+            for (int p=0; p<player_count; p++) {
+                if (!players[p].alive) continue;
+                if (circle_hit(bullets[b].x, bullets[b].y, NUM(2.0f), players[p].x, players[p].y, NUM(10.0f))) {
+                    players[p].alive = false;
+                    kill_bullet(b);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Adaptive quality governor
+ * Feeds on the cost of each frame and scales back what players notice least
+ * when the average over a window exceeds the budget: first background dot
+ * density, then blood splat detail, then soldier detail. Quality returns one
+ * step at a time after a run of frames with clear headroom. Restoring straight
+ * into another overrun doubles the run needed next time, to avoid flapping.
+ */
+static void govern_quality(float work_sec, float interval_sec) {
+    // a dropped frame costs its whole interval, otherwise count the work
+    float cost = work_sec;
+    if (interval_sec > 1.5f*QUALITY_BUDGET_SEC) cost = interval_sec;
+    if (cost > 4.0f*QUALITY_BUDGET_SEC) cost = 4.0f*QUALITY_BUDGET_SEC; // one-off hitches
+
+    quality.window_sum += cost;
+    quality.window_frames++;
+    if (cost < QUALITY_HEADROOM*QUALITY_BUDGET_SEC) {
+        quality.headroom_frames++;
+    } else {
+        quality.headroom_frames = 0;
+    }
+
+    if (quality.window_frames >= QUALITY_WINDOW_FRAMES) {
+        float avg = quality.window_sum / (float)quality.window_frames;
+        quality.window_sum = 0.0f;
+        quality.window_frames = 0;
+        if (avg > QUALITY_BUDGET_SEC && quality.level < QUALITY_LEVELS-1) {
+            if (quality.just_restored && quality.restore_frames < QUALITY_RESTORE_MAX_FRAMES) {
+                quality.restore_frames *= 2;
+            }
+            quality.level++;
+            quality.headroom_frames = 0;
+            quality.just_restored = false;
+            if (verbose) fprintf(stderr, "quality level: %d (avg frame %.1f ms)\n", quality.level, avg*1000.0f);
+            return;
+        }
+        if (avg <= QUALITY_BUDGET_SEC) quality.just_restored = false;
+    }
+
+    if (quality.headroom_frames >= quality.restore_frames && quality.level > QUALITY_FULL) {
+        quality.level--;
+        quality.headroom_frames = 0;
+        quality.window_sum = 0.0f;
+        quality.window_frames = 0;
+        quality.just_restored = true;
+        if (verbose) fprintf(stderr, "quality level: %d\n", quality.level);
+    }
+}
+
+/**
+ * Software rasterizer
+ * Optional backend that draws the whole scene into a CPU-side ARGB framebuffer
+ * and hands it to the GPU as one texture upload and one copy. On SDL's software
+ * or offscreen renderers this beats thousands of tiny driver calls per frame.
+ */
+static void fill_span(uint32_t *dst, int n, uint32_t c) {
+    u32x4 v = { c, c, c, c };
+    int i = 0;
+    for (; i+4<=n; i+=4) memcpy(dst+i, &v, sizeof v); // unaligned 4-pixel store
+    for (; i<n; i++) dst[i] = c;
+}
+
+static void soft_fill_rect(int x, int y, int w, int h) {
+    // clip to the framebuffer
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > SCREEN_W) w = SCREEN_W - x;
+    if (y + h > SCREEN_H) h = SCREEN_H - y;
+    if (w <= 0 || h <= 0) return;
+
+    uint32_t *row = soft_fb + y*SCREEN_W + x;
+    for (int j=0; j<h; j++) {
+        fill_span(row, w, soft_color);
+        row += SCREEN_W;
+    }
+}
+
+static bool init_soft_render(SDL_Renderer *ren) {
+    soft_fb = malloc(sizeof(uint32_t) * SCREEN_W * SCREEN_H);
+    if (!soft_fb) return false;
+    soft_tex = SDL_CreateTexture(ren, SDL_PIXELFORMAT_ARGB8888,
+        SDL_TEXTUREACCESS_STREAMING, SCREEN_W, SCREEN_H);
+    if (!soft_tex) {
+        SDL_Log("SDL_CreateTexture failed: %s", SDL_GetError());
+        free(soft_fb);
+        soft_fb = NULL;
+        return false;
+    }
+    return true;
+}
+
+static void free_soft_render(void) {
+    if (soft_tex) SDL_DestroyTexture(soft_tex);
+    free(soft_fb);
+    soft_tex = NULL;
+    soft_fb = NULL;
+}
+
+/**
+ * Upload the software framebuffer, if in use, as the frame to present
+ */
+static void finish_frame(SDL_Renderer *ren) {
+    if (!soft_fb) return;
+    SDL_SetRenderDrawColor(ren, 45, 35, 25, 255); // letterbox matches the ground
+    SDL_RenderClear(ren);
+    SDL_UpdateTexture(soft_tex, NULL, soft_fb, SCREEN_W * (int)sizeof(uint32_t));
+    SDL_RenderCopy(ren, soft_tex, NULL, NULL);
+}
+
+/**
+ * Sets the draw color for either backend
+ */
+static void set_color(SDL_Renderer *ren, Uint8 r, Uint8 g, Uint8 b) {
+    if (soft_fb) {
+        soft_color = 0xFF000000u | ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+    } else {
+        SDL_SetRenderDrawColor(ren, r, g, b, 255);
+    }
+}
+
+/**
+ * Fills the whole screen with the draw color
+ */
+static void clear_screen(SDL_Renderer *ren) {
+    if (soft_fb) {
+        fill_span(soft_fb, SCREEN_W*SCREEN_H, soft_color);
+    } else {
+        SDL_RenderClear(ren);
+    }
+}
+
+/**
+ * Draws a rectangle at exact start and end coordinates
+ */
+static void draw_rect(SDL_Renderer *ren, int x, int y, int w, int h) {
+    if (soft_fb) {
+        soft_fill_rect(x, y, w, h);
+        return;
+    }
+    SDL_Rect r = { x, y, w, h };
+    SDL_RenderFillRect(ren, &r);
+}
+
+/**
+ * Precompute the half-width of every row of every circle up to the max radius
+ */
+static void build_circle_spans(void) {
+    for (int r=0; r<=CIRCLE_MAX_RADIUS; r++) {
+        for (int dy=-r; dy<=r; dy++) {
+            int hw = 0;
+            while ((hw+1)*(hw+1) + dy*dy <= r*r) hw++;
+            circle_spans[r][dy+r] = (Uint8)hw;
+        }
+    }
+}
+
+/**
+ * Draws a circle, one span per row
+ */
+static void draw_filled_circle(SDL_Renderer *ren, int cx, int cy, int r) {
+    if (r > CIRCLE_MAX_RADIUS) r = CIRCLE_MAX_RADIUS;
+    for (int dy=-r; dy<=r; dy++) {
+        int hw = circle_spans[r][dy+r];
+        draw_rect(ren, cx-hw, cy+dy, 2*hw+1, 1);
+    }
+}
+
+/**
+ * Draws a soldier
+ */
+static void draw_soldier(SDL_Renderer *ren, int x, int y, bool player_flag) {
+    // outline
+    set_color(ren, 20, 15, 10);
+    draw_rect(ren, x-9, y-9, 18,18);
+
+    // coat / body
+    if (player_flag) {
+    	set_color(ren, 110, 90, 50);
+    } else {
+    	set_color(ren, 80, 100, 80);
+    }
+    draw_rect(ren, x-8, y-8, 16,14);
+    if (quality.level >= QUALITY_FLAT_SOLDIERS) return;
+
+    // boots / lower
+    if (player_flag) {
+    	set_color(ren, 70, 50, 30);
+    } else {
+    	set_color(ren, 40, 50, 40);
+    }
+    draw_rect(ren, x-8, y+2, 16,4);
+
+    // helmet
+    if (player_flag) {
+    	set_color(ren, 90, 70, 40);
+    } else {
+    	set_color(ren, 60, 80, 60);
+    }
+    draw_rect(ren, x-7, y-12, 14,5);
+
+    // helmet rim highlight
+    if (player_flag) {
+    	set_color(ren, 200, 180, 120);
+    } else {
+    	set_color(ren, 140, 170, 140);
+    }
+    draw_rect(ren, x-7, y-12, 14,2);
+}
+
+/**
+ * Minimal pixel font
+ */
+static const char *glyph_for_char(char c) {
+    switch (c) {
+    	case ' ': return ".....""....."".....""....."".....";
+        case '.': return "....."".....""....."".##.."".##..";
+        case ',': return "....."".....""....."".##..""..#..";
+        case ':': return ".##.."".##..""....."".##.."".##..";
+        case '-': return "....."".....""#####""....."".....";
         case '!': return "#####"".###."".###.""....."".###.";
         case '/': return "....#""...#.""..#.."".#...""#....";
         case '[': return "#####""##...""##...""##...""#####";
@@ -652,231 +2238,1592 @@ static const char *glyph_for_char(char c) {
     }
 }
 
-/**
- * Draw text
- */
-static void draw_text(SDL_Renderer *ren, int x, int y, const char *msg, SDL_Color color) {
-    SDL_SetRenderDrawColor(ren, color.r, color.g, color.b, color.a);
-    int cursor_x = x;
-    for (const char *p = msg; *p; p++) {
-        const char *g = glyph_for_char(*p);
-        for (int gy=0; gy<5; gy++) { // font is 5 high
-            for (int gx=0; gx<5; gx++) { // and 5 wide
-                char pixel = g[gy*5 + gx];
-                if (pixel == '#') {
-                    draw_rect_scaled(ren, cursor_x + gx*FONT_SCALE, y + gy*FONT_SCALE, FONT_SCALE);
-                }
-            }
-        }
-        cursor_x += 6*FONT_SCALE; // using 5 wide leaves a gap of 1 pixel
+/**
+ * Unpack the pixel font into one 5-bit mask per glyph row, leftmost pixel high
+ */
+static void build_glyph_rows(void) {
+    for (int c=0; c<GLYPH_COUNT; c++) {
+        const char *g = glyph_for_char((char)c);
+        for (int gy=0; gy<5; gy++) {
+            Uint8 bits = 0;
+            for (int gx=0; gx<5 && g; gx++) {
+                if (g[gy*5 + gx] == '#') bits |= (Uint8)(0x10 >> gx);
+            }
+            glyph_rows[c][gy] = bits;
+        }
+    }
+}
+
+/**
+ * Draw text, one rect per horizontal run of glyph pixels
+ */
+static void draw_text(SDL_Renderer *ren, int x, int y, const char *msg, SDL_Color color) {
+    set_color(ren, color.r, color.g, color.b);
+    int cursor_x = x;
+    for (const char *p = msg; *p; p++) {
+        const Uint8 *rows = glyph_rows[(unsigned char)*p % GLYPH_COUNT];
+        for (int gy=0; gy<5; gy++) { // font is 5 high
+            int gx = 0;
+            while (gx < 5) { // and 5 wide
+                if (!(rows[gy] & (0x10 >> gx))) { gx++; continue; }
+                int run = 1;
+                while (gx+run < 5 && (rows[gy] & (0x10 >> (gx+run)))) run++;
+                draw_rect(ren, cursor_x + gx*FONT_SCALE, y + gy*FONT_SCALE, run*FONT_SCALE, FONT_SCALE);
+                gx += run;
+            }
+        }
+        cursor_x += 6*FONT_SCALE; // using 5 wide leaves a gap of 1 pixel
+    }
+}
+
+/**
+ * Draw tree
+ */
+static void draw_tree(SDL_Renderer *ren, int x, int y) {
+    set_color(ren, 40, 25, 15); // stump
+    draw_rect(ren, x-2, y-8, 4,16);
+    set_color(ren, 50, 70, 40); // canopy
+    draw_rect(ren, x-6, y-14, 12,8);
+    set_color(ren, 100, 130, 80); // highlight
+    draw_rect(ren, x-4, y-14, 4,4);
+}
+
+/**
+ * Draw rock
+ */
+static void draw_rock(SDL_Renderer *ren, int x, int y) {
+    set_color(ren, 80, 80, 80); // dark base
+    draw_rect(ren, x-6, y-4, 12,8);
+    set_color(ren, 140, 140, 140); // highlight
+    draw_rect(ren, x-2, y-4, 4,3);
+}
+
+/**
+ * Draw barbed wire
+ */
+static void draw_wire(SDL_Renderer *ren, int x, int y) {
+    set_color(ren, 150, 150, 150);
+    draw_rect(ren, x-10, y-1, 20,2);   // strand
+    draw_rect(ren, x-6,  y-5, 2,8);    // barb
+    draw_rect(ren, x+2,  y-5, 2,8);    // barb
+}
+
+/**
+ * Draw all props at their randomized locations
+ */
+static void draw_props(SDL_Renderer *ren) {
+    for (int i=0; i<wire_count; i++) {
+        draw_wire(ren, num_to_int(wires[i].x), num_to_int(wires[i].y));
+    }
+    for (int i=0; i<rock_count; i++) {
+        draw_rock(ren, num_to_int(rocks[i].x), num_to_int(rocks[i].y));
+    }
+    for (int i=0; i<tree_count; i++) {
+        if (trees[i].alive) draw_tree(ren, num_to_int(trees[i].x), num_to_int(trees[i].y));
+    }
+}
+
+/**
+ * Draw the live particles in one batch: a single SDL_RenderGeometry call, or
+ * alpha blended straight into the software framebuffer
+ */
+static void soft_blend(uint32_t *dst, uint32_t c, uint32_t a) {
+    uint32_t d = *dst;
+    uint32_t rb = ((c & 0xFF00FFu) * a + (d & 0xFF00FFu) * (256 - a)) >> 8;
+    uint32_t g = ((c & 0x00FF00u) * a + (d & 0x00FF00u) * (256 - a)) >> 8;
+    *dst = 0xFF000000u | (rb & 0xFF00FFu) | (g & 0x00FF00u);
+}
+
+static void draw_particles(SDL_Renderer *ren) {
+    if (!fx.x) return;
+    int quads = 0;
+    for (uint32_t i=fx.tail; i!=fx.head; i++) {
+        uint32_t s = i & (PARTICLE_CAP-1);
+        if (fx.life[s] <= 0.0f) continue;
+        float alpha = fx.life[s] * fx.fade[s]; // 1 at birth, 0 at death
+        uint32_t c = fx.color[s];
+        if (soft_fb) {
+            int x = (int)fx.x[s];
+            int y = (int)fx.y[s];
+            if (x < 0 || y < 0 || x+1 >= SCREEN_W || y+1 >= SCREEN_H) continue;
+            uint32_t a = (uint32_t)(alpha * 256.0f);
+            uint32_t *p = soft_fb + y*SCREEN_W + x;
+            soft_blend(p, c, a);
+            soft_blend(p+1, c, a);
+            soft_blend(p+SCREEN_W, c, a);
+            soft_blend(p+SCREEN_W+1, c, a);
+        } else {
+            SDL_Color col = { (Uint8)(c >> 16), (Uint8)(c >> 8), (Uint8)c, (Uint8)(alpha * 255.0f) };
+            float x0 = fx.x[s] - PARTICLE_SIZE/2, x1 = x0 + PARTICLE_SIZE;
+            float y0 = fx.y[s] - PARTICLE_SIZE/2, y1 = y0 + PARTICLE_SIZE;
+            SDL_Vertex *v = fx.verts + 4*quads++;
+            v[0].position.x = x0; v[0].position.y = y0;
+            v[1].position.x = x1; v[1].position.y = y0;
+            v[2].position.x = x0; v[2].position.y = y1;
+            v[3].position.x = x1; v[3].position.y = y1;
+            for (int k=0; k<4; k++) {
+                v[k].color = col;
+                v[k].tex_coord.x = v[k].tex_coord.y = 0.0f;
+            }
+        }
+    }
+    if (quads > 0) {
+        SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_BLEND);
+        SDL_RenderGeometry(ren, NULL, fx.verts, 4*quads, fx.indices, 6*quads);
+        SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_NONE);
+    }
+}
+
+/**
+ * Draw the background dots
+ */
+static void draw_dots(SDL_Renderer *ren) {
+    // dots are scattered at random, so striding thins them out evenly
+    int stride = 1;
+    if (quality.level >= QUALITY_QUARTER_DOTS) stride = 4;
+    else if (quality.level >= QUALITY_HALF_DOTS) stride = 2;
+    for (int i=0; i<dot_count; i+=stride) {
+        const Uint8 *c = dot_palette[dots[i].tone];
+        set_color(ren, c[0], c[1], c[2]);
+        // draw a 1-2 pixel speckle
+        // tiny jitter to avoid perfect squares
+        draw_rect(ren, dots[i].x, dots[i].y, 2, 2);
+    }
+}
+
+/**
+ * get pixel width of a string
+ */
+static int get_text_width(const char *msg) {
+    int w = 0;
+    for (const char *p = msg; *p; p++) {
+        w += 6*FONT_SCALE; // 5 wide + 1 pixel gap
+    }
+    return w;
+}
+
+/**
+ * draw text centered around (cx, cy)
+ */
+static void draw_text_centered(SDL_Renderer *ren, int cx, int cy, const char *msg, SDL_Color color) {
+    int w = get_text_width(msg);
+    int h = 5*FONT_SCALE; // glyphs are 5 high, line gap is up to cy
+    int x = cx - w / 2;
+    int y = cy - h / 2;
+    draw_text(ren, x, y, msg, color);
+}
+
+/**
+ * Render graphics
+ */
+static void render(SDL_Renderer *ren) {
+    set_color(ren, 45, 35, 25); // base muddy ground
+    clear_screen(ren);
+    draw_dots(ren);
+    draw_props(ren);
+
+    // draw enemy blood
+    for (int i=0;i<enemy_pool.hi;i++) {
+        if (enemy_flags[i] & ENEMY_DYING) {
+            const Enemy *e = &enemies[i];
+            set_color(ren, 140, 0, 0);
+            if (quality.level >= QUALITY_FLAT_BLOOD) {
+                draw_rect(ren, num_to_int(e->x)-8, num_to_int(e->y)-8, 16, 16);
+            } else {
+                draw_filled_circle(ren, num_to_int(e->x), num_to_int(e->y), 10);
+            }
+        }
+    }
+
+    // draw enemies alive
+    for (int i=0;i<enemy_pool.hi;i++) {
+        if (enemy_flags[i] & ENEMY_ALIVE) {
+            const Enemy *e = &enemies[i];
+            draw_soldier(ren, num_to_int(e->x), num_to_int(e->y), false);
+        }
+    }
+
+    // draw bullets
+    for (int i=0;i<bullet_pool.hi;i++) {
+        if (!(bullet_flags[i] & BULLET_ALIVE)) continue;
+        if (bullet_flags[i] & BULLET_FROM_ENEMY) {
+            set_color(ren, 200, 60, 40); // enemy tracer
+        } else {
+            set_color(ren, 240, 220, 80); // player tracer
+        }
+        draw_rect(ren, num_to_int(bullets[i].x)-2, num_to_int(bullets[i].y)-2, 4,4);
+    }
+    draw_particles(ren);
+
+    // draw players
+    if (game_won) {
+        set_color(ren, 0, 0, 0);
+        draw_rect(ren, 0, 0, SCREEN_W, SCREEN_H);
+    }
+    for (int p=0; p<player_count && !game_won; p++) {
+        Player *pl = &players[p];
+        if (!pl->alive) {
+            set_color(ren, 180, 0, 0);
+            draw_filled_circle(ren, num_to_int(pl->x), num_to_int(pl->y), 14);
+            continue;
+        }
+        draw_soldier(ren, num_to_int(pl->x), num_to_int(pl->y), true);
+        if (p > 0) {
+            set_color(ren, 220, 220, 200); // second tommy wears a scarf
+            draw_rect(ren, num_to_int(pl->x)-8, num_to_int(pl->y)-7, 16, 2);
+        }
+
+        // rifle direction marker
+        num dx = pl->aimx;
+        num dy = pl->aimy;
+        if (num_abs(dx) < NUM(0.001f) && num_abs(dy) < NUM(0.001f)) {
+            dx = 0; dy = NUM(-1.0f);
+        }
+        normalize(&dx,&dy);
+        int gunx = (int)(num_to_float(pl->x) + num_to_float(dx)*12.0f);
+        int guny = (int)(num_to_float(pl->y) + num_to_float(dy)*12.0f);
+
+        set_color(ren, 90, 56, 34); // outer 'woody' color
+        draw_rect(ren, gunx-3, guny-3, 6,6);
+
+        set_color(ren, 140, 140, 140); // inner 'metal' color
+        draw_rect(ren, gunx-2, guny-2, 4,4);
+    }
+
+    SDL_Color fontcol = {255, 220, 180, 255};
+
+    // timer
+    {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "TIME %.1f", num_to_float(survival_time));
+        draw_text(ren, 10, 10, buf, fontcol);
+    }
+    
+    // pause
+    if (paused) {
+        SDL_Color pause_color = {255, 255, 255, 255};
+        if(show_welcome_msg) {
+            draw_text_centered(ren, CENTER_W, CENTER_H-210, "##################", fontcol);
+            draw_text_centered(ren, CENTER_W, CENTER_H-180, "# THE LOST TOMMY #", fontcol);
+            draw_text_centered(ren, CENTER_W, CENTER_H-150, "##################", fontcol);
+            draw_text_centered(ren, CENTER_W, CENTER_H-30, "MOVE: W A S D", fontcol);
+            draw_text_centered(ren, CENTER_W, CENTER_H+30, "FIRE: I J K L", fontcol);
+            draw_text_centered(ren, CENTER_W, CENTER_H+90, "START/PAUSE: SPACEBAR", fontcol);
+            draw_text_centered(ren, CENTER_W, CENTER_H+150, "TOGGLE FULLSCREEN: F1", fontcol);
+            draw_text_centered(ren, CENTER_W, CENTER_H+210, "QUIT: ESC", fontcol);
+        } else {
+            draw_text_centered(ren, CENTER_W, CENTER_H-30, "GAME IS PAUSED", fontcol);
+            draw_text_centered(ren, CENTER_W, CENTER_H+30, "PRESS SPACEBAR TO RESUME", fontcol);
+        }
+    }
+
+    if (net.mode != NET_OFF && !net.connected) {
+        draw_text_centered(ren, CENTER_W, CENTER_H-30, "WAITING FOR PEER", fontcol);
+    }
+
+    // game over message
+    if (game_over) {
+        if (game_won) {
+            draw_text_centered(ren, CENTER_W, CENTER_H-30, "YOU SURVIVED!", fontcol);
+        } else {
+            draw_text_centered(ren, CENTER_W, CENTER_H-30, "YOU DIED!", fontcol);
+        }
+        draw_text_centered(ren, CENTER_W, CENTER_H+30, "PRESS SPACEBAR TO PLAY AGAIN", fontcol);
+	}
+}
+
+/**
+ * Frame capture
+ * Streams raw frames to disk as a single Y4M video (when the path ends in
+ * .y4m) or as a numbered PPM sequence in a directory. A writer thread drains
+ * a small bounded queue, so file I/O never runs on the simulation thread.
+ */
+static bool ends_with(const char *s, const char *suffix) {
+    size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+static bool capture_write_frame(FrameCapture *cap, const uint32_t *px) {
+    if (cap->y4m) {
+        // planar full-resolution BT.601 YCbCr
+        Uint8 *yp = cap->scratch;
+        Uint8 *up = yp + SCREEN_W*SCREEN_H;
+        Uint8 *vp = up + SCREEN_W*SCREEN_H;
+        for (int i=0; i<SCREEN_W*SCREEN_H; i++) {
+            int r = (px[i] >> 16) & 0xFF, g = (px[i] >> 8) & 0xFF, b = px[i] & 0xFF;
+            yp[i] = (Uint8)(( 66*r + 129*g +  25*b + 128 + (16 << 8)) >> 8);
+            up[i] = (Uint8)((-38*r -  74*g + 112*b + 128 + (128 << 8)) >> 8);
+            vp[i] = (Uint8)((112*r -  94*g -  18*b + 128 + (128 << 8)) >> 8);
+        }
+        fputs("FRAME\n", cap->y4m);
+        return fwrite(cap->scratch, 1, 3*SCREEN_W*SCREEN_H, cap->y4m) == 3*SCREEN_W*SCREEN_H;
+    }
+
+    for (int i=0; i<SCREEN_W*SCREEN_H; i++) {
+        cap->scratch[i*3 + 0] = (Uint8)(px[i] >> 16);
+        cap->scratch[i*3 + 1] = (Uint8)(px[i] >> 8);
+        cap->scratch[i*3 + 2] = (Uint8)px[i];
+    }
+    char name[1024];
+    snprintf(name, sizeof(name), "%s/frame_%06d.ppm", cap->path, cap->written);
+    FILE *f = fopen(name, "wb");
+    if (!f) return false;
+    fprintf(f, "P6\n%d %d\n255\n", SCREEN_W, SCREEN_H);
+    bool ok = fwrite(cap->scratch, 1, 3*SCREEN_W*SCREEN_H, f) == 3*SCREEN_W*SCREEN_H;
+    return fclose(f) == 0 && ok;
+}
+
+static int capture_writer(void *arg) {
+    FrameCapture *cap = (FrameCapture *)arg;
+    for (;;) {
+        SDL_LockMutex(cap->lock);
+        while (cap->count == 0 && !cap->closing) SDL_CondWait(cap->cond, cap->lock);
+        if (cap->count == 0) {
+            SDL_UnlockMutex(cap->lock);
+            return 0;
+        }
+        const uint32_t *px = cap->slots + (size_t)cap->head * SCREEN_W*SCREEN_H;
+        SDL_UnlockMutex(cap->lock);
+
+        // the slot stays counted, and thus untouched by the producer, while writing
+        if (!cap->failed && !capture_write_frame(cap, px)) {
+            fprintf(stderr, "capture: failed to write frame %d to %s\n", cap->written, cap->path);
+            cap->failed = true;
+        }
+
+        SDL_LockMutex(cap->lock);
+        if (!cap->failed) cap->written++; // frames after a failure are dropped
+        cap->head = (cap->head + 1) % CAPTURE_QUEUE_FRAMES;
+        cap->count--;
+        SDL_CondBroadcast(cap->cond);
+        SDL_UnlockMutex(cap->lock);
+    }
+}
+
+static bool capture_open(FrameCapture *cap, const char *path) {
+    memset(cap, 0, sizeof(*cap));
+    cap->path = path;
+    if (ends_with(path, ".y4m")) {
+        cap->y4m = fopen(path, "wb");
+        if (!cap->y4m) {
+            fprintf(stderr, "capture: cannot open %s\n", path);
+            return false;
+        }
+        fprintf(cap->y4m, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", SCREEN_W, SCREEN_H, CAPTURE_FPS);
+    }
+    cap->slots = malloc(sizeof(uint32_t) * SCREEN_W*SCREEN_H * CAPTURE_QUEUE_FRAMES);
+    cap->scratch = malloc(3 * SCREEN_W*SCREEN_H);
+    cap->lock = SDL_CreateMutex();
+    cap->cond = SDL_CreateCond();
+    if (cap->slots && cap->scratch && cap->lock && cap->cond) {
+        cap->thread = SDL_CreateThread(capture_writer, "capture", cap);
+    }
+    if (!cap->thread) {
+        fprintf(stderr, "capture: cannot start writer: %s\n", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Queue a frame, waiting only while all slots are still being written
+ */
+static void capture_push(FrameCapture *cap, const uint32_t *px) {
+    SDL_LockMutex(cap->lock);
+    if (cap->count == CAPTURE_QUEUE_FRAMES) cap->stalls++;
+    while (cap->count == CAPTURE_QUEUE_FRAMES) SDL_CondWait(cap->cond, cap->lock);
+    int idx = (cap->head + cap->count) % CAPTURE_QUEUE_FRAMES;
+    SDL_UnlockMutex(cap->lock);
+
+    memcpy(cap->slots + (size_t)idx * SCREEN_W*SCREEN_H, px, sizeof(uint32_t) * SCREEN_W*SCREEN_H);
+
+    SDL_LockMutex(cap->lock);
+    cap->count++;
+    SDL_CondBroadcast(cap->cond);
+    SDL_UnlockMutex(cap->lock);
+}
+
+/**
+ * Flush the queue and release everything; returns false if any write failed
+ */
+static bool capture_close(FrameCapture *cap) {
+    if (cap->thread) {
+        SDL_LockMutex(cap->lock);
+        cap->closing = true;
+        SDL_CondBroadcast(cap->cond);
+        SDL_UnlockMutex(cap->lock);
+        SDL_WaitThread(cap->thread, NULL);
+    }
+    if (cap->y4m && fclose(cap->y4m) != 0) cap->failed = true;
+    if (cap->cond) SDL_DestroyCond(cap->cond);
+    if (cap->lock) SDL_DestroyMutex(cap->lock);
+    free(cap->slots);
+    free(cap->scratch);
+    return !cap->failed;
+}
+
+/**
+ * Advance the simulation by one frame
+ */
+static void step_game(num dt, const InputBits *inputs) {
+    for (int p=0; p<player_count; p++) {
+        control_player(&players[p], dt, inputs[p]);
+    }
+    move_bullets(dt);
+    advance_timers(dt);
+    move_enemies(dt);
+    handle_props_effects();
+    handle_bullet_actor_collisions();
+
+    // survival timer
+    survival_time += dt;
+    if (!game_won && survival_time >= win_time) {
+        survival_time = win_time; // clamp
+        game_won = true;
+        for (int p=0; p<player_count; p++) {
+            players[p].alive = false; // end the round
+        }
+    }
+}
+
+/**
+ * Snapshots
+ * One contiguous block: a header with every scalar the simulation owns,
+ * followed by a byte copy of the round arena. The arena holds indices but
+ * no pointers, so saving and restoring are two memcpys.
+ */
+static size_t snapshot_size(void) {
+    return sizeof(SnapshotHeader) + arena.snapshot_bytes;
+}
+
+static void fill_snapshot_header(SnapshotHeader *hp) {
+    SnapshotHeader h;
+    memset(&h, 0, sizeof(h));
+    h.arena_bytes = (uint32_t)arena.snapshot_bytes;
+    h.round_id = round_id;
+    h.round_seed = round_seed;
+    memcpy(h.players, players, sizeof(players));
+    h.rng_state = rng_state;
+    h.survival_time = survival_time;
+    h.game_over = game_over;
+    h.game_won = game_won;
+    h.tree_count = tree_count;
+    h.rock_count = rock_count;
+    h.wire_count = wire_count;
+    h.bullet_free_count = bullet_pool.free_count;
+    h.bullet_hi = bullet_pool.hi;
+    h.enemy_free_count = enemy_pool.free_count;
+    h.enemy_hi = enemy_pool.hi;
+    h.wheel = wheel;
+    *hp = h;
+}
+
+static void restore_snapshot_header(const SnapshotHeader *hp) {
+    SnapshotHeader h = *hp;
+    memcpy(players, h.players, sizeof(players));
+    rng_state = h.rng_state;
+    round_id = h.round_id;
+    round_seed = h.round_seed;
+    survival_time = h.survival_time;
+    game_over = h.game_over;
+    game_won = h.game_won;
+    tree_count = h.tree_count;
+    rock_count = h.rock_count;
+    wire_count = h.wire_count;
+    bullet_pool.free_count = h.bullet_free_count;
+    bullet_pool.hi = h.bullet_hi;
+    enemy_pool.free_count = h.enemy_free_count;
+    enemy_pool.hi = h.enemy_hi;
+    wheel = h.wheel;
+}
+
+static void save_snapshot(unsigned char *buf) {
+    SnapshotHeader h;
+    fill_snapshot_header(&h);
+    memcpy(buf, &h, sizeof(h));
+    memcpy(buf + sizeof(h), arena.base, arena.snapshot_bytes);
+}
+
+static bool load_snapshot(const unsigned char *buf) {
+    SnapshotHeader h;
+    memcpy(&h, buf, sizeof(h));
+    if (h.arena_bytes != arena.snapshot_bytes) return false;
+    if (h.round_id != round_id) {
+        // rolled back past a restart: rebuild that round's dots, rocks, wire
+        // and prop grid from the same generator state; the rest comes below
+        rng_state = h.round_seed;
+        generate_dots();
+        generate_props();
+    }
+    restore_snapshot_header(&h);
+    memcpy(arena.base, buf + sizeof(h), arena.snapshot_bytes);
+    return true;
+}
+
+/**
+ * State hash
+ * FNV-1a over exactly what a snapshot holds. Builds agree on a tick when
+ * their hashes do, so a per-tick log pins down the first tick two targets
+ * part ways. The header goes in field by field, since its padding differs
+ * between ABIs; the arena is zeroed when allocated, so its padding is too.
+ */
+static uint32_t fnv1a(uint32_t h, const unsigned char *p, size_t n) {
+    for (size_t i=0; i<n; i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+#define FNV1A_FIELD(h, f) ((h) = fnv1a((h), (const unsigned char *)&(f), sizeof(f)))
+
+static uint32_t state_hash(void) {
+    SnapshotHeader h;
+    fill_snapshot_header(&h);
+    uint32_t x = 2166136261u;
+    FNV1A_FIELD(x, h.arena_bytes);
+    FNV1A_FIELD(x, h.round_id);
+    for (int p=0; p<MAX_PLAYERS; p++) {
+        const Player *pl = &h.players[p];
+        FNV1A_FIELD(x, pl->x);
+        FNV1A_FIELD(x, pl->y);
+        FNV1A_FIELD(x, pl->aimx);
+        FNV1A_FIELD(x, pl->aimy);
+        FNV1A_FIELD(x, pl->shoot_cooldown);
+        FNV1A_FIELD(x, pl->alive);
+    }
+    FNV1A_FIELD(x, h.rng_state);
+    FNV1A_FIELD(x, h.round_seed);
+    FNV1A_FIELD(x, h.survival_time);
+    FNV1A_FIELD(x, h.game_over);
+    FNV1A_FIELD(x, h.game_won);
+    FNV1A_FIELD(x, h.tree_count);
+    FNV1A_FIELD(x, h.rock_count);
+    FNV1A_FIELD(x, h.wire_count);
+    FNV1A_FIELD(x, h.bullet_free_count);
+    FNV1A_FIELD(x, h.bullet_hi);
+    FNV1A_FIELD(x, h.enemy_free_count);
+    FNV1A_FIELD(x, h.enemy_hi);
+    FNV1A_FIELD(x, h.wheel.now);
+    FNV1A_FIELD(x, h.wheel.accum);
+    FNV1A_FIELD(x, h.wheel.heads);
+    return fnv1a(x, arena.base, arena.snapshot_bytes);
+}
+
+/**
+ * Suspend file
+ * A running round written out in a layout that can be mapped straight back
+ * in: a fixed header, the background dots, then the round arena byte for
+ * byte. Resuming maps the file copy-on-write and points the pools at it,
+ * with no regeneration or parsing. The layout is native, so a file is only
+ * valid for a build with the same version and struct sizes.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t sizes[8];      // struct sizes the layout depends on
+    int32_t bullet_cap, enemy_cap, prop_cap;
+    int32_t scenario;
+    int32_t dot_count;
+    uint64_t dots_offset;
+    uint64_t arena_offset;
+    uint64_t arena_bytes;
+    SnapshotHeader state;
+} SuspendHeader;
+
+static void suspend_sizes(uint32_t *sizes) {
+    sizes[0] = sizeof(SuspendHeader);
+    sizes[1] = sizeof(SnapshotHeader);
+    sizes[2] = sizeof(Bullet);
+    sizes[3] = sizeof(Enemy);
+    sizes[4] = sizeof(Timer);
+    sizes[5] = sizeof(Tree);
+    sizes[6] = sizeof(PropSpot);
+    sizes[7] = sizeof(Dot);
+}
+
+/**
+ * Move a resumed round off its mapping, so the file can be rewritten
+ */
+static bool detach_round(void) {
+    if (!arena.mapping) return true;
+    unsigned char *copy = malloc(arena.size);
+    if (!copy) return false;
+    memcpy(copy, arena.base, arena.size);
+    memcpy(dot_storage, dots, sizeof(Dot) * dot_count);
+    unmap_file(arena.mapping, arena.mapping_size);
+    arena.mapping = NULL;
+    arena.mapping_size = 0;
+    arena.base = copy;
+    dots = dot_storage;
+    layout_round();
+    return true;
+}
+
+static bool suspend_round(const char *path) {
+    if (!detach_round()) return false;
+    SuspendHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = SUSPEND_MAGIC;
+    h.version = SUSPEND_FORMAT;
+    suspend_sizes(h.sizes);
+    h.bullet_cap = bullet_cap;
+    h.enemy_cap = enemy_cap;
+    h.prop_cap = prop_cap;
+    h.scenario = (int32_t)(scenario - scenarios);
+    h.dot_count = dot_count;
+    h.dots_offset = arena_size(sizeof(h));
+    h.arena_offset = h.dots_offset + arena_size(sizeof(Dot) * dot_count);
+    h.arena_bytes = arena.used;
+    fill_snapshot_header(&h.state);
+
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
+    static const Uint8 pad[ARENA_ALIGN];
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1
+        && fwrite(pad, 1, h.dots_offset - sizeof(h), f) == h.dots_offset - sizeof(h)
+        && fwrite(dots, sizeof(Dot), (size_t)dot_count, f) == (size_t)dot_count
+        && fwrite(pad, 1, h.arena_offset - h.dots_offset - sizeof(Dot) * dot_count, f)
+            == h.arena_offset - h.dots_offset - sizeof(Dot) * dot_count
+        && fwrite(arena.base, 1, arena.used, f) == arena.used;
+    return fclose(f) == 0 && ok;
+}
+
+static void *map_file(const char *path, size_t *size) {
+#ifdef __EMSCRIPTEN__
+    (void)path; (void)size;
+    return NULL;
+#elif defined(_WIN32)
+    HANDLE f = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, NULL);
+    if (f == INVALID_HANDLE_VALUE) return NULL;
+    LARGE_INTEGER len;
+    len.QuadPart = 0;
+    HANDLE m = NULL;
+    void *p = NULL;
+    if (GetFileSizeEx(f, &len) && len.QuadPart > 0) {
+        m = CreateFileMappingA(f, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    }
+    if (m) {
+        p = MapViewOfFile(m, FILE_MAP_COPY, 0, 0, 0);
+        CloseHandle(m);
+    }
+    CloseHandle(f);
+    *size = (size_t)len.QuadPart;
+    return p;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    st.st_size = 0;
+    void *p = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        // private and writable: the round plays on in copy-on-write pages
+        p = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) p = NULL;
+    }
+    close(fd);
+    *size = (size_t)st.st_size;
+    return p;
+#endif
+}
+
+static bool in_range(int v, int lo, int hi) {
+    return v >= lo && v <= hi;
+}
+
+/**
+ * Every slot is either on the free stack, once, or in use below hi, as
+ * pools_consistent expects; anything else lets a release overrun the stack
+ */
+static bool pool_valid(const int *free_stack, int free_count, int hi, int cap,
+                       const uint8_t *flags, uint8_t in_use, uint8_t *seen) {
+    memset(seen, 0, (size_t)cap);
+    for (int k=0; k<free_count; k++) {
+        int i = free_stack[k];
+        if (!in_range(i, 0, cap-1) || seen[i] || (flags[i] & in_use)) return false;
+        seen[i] = 1;
+    }
+    for (int i=0; i<cap; i++) {
+        if (!seen[i] && (i >= hi || !(flags[i] & in_use))) return false;
+    }
+    return true;
+}
+
+/**
+ * Every scheduled timer sits once in the list of its own slot, with its
+ * links agreeing both ways, and fits the enemy that owns it; otherwise
+ * advancing the wheel could loop forever or release a slot twice
+ */
+static bool wheel_valid(const TimerWheel *w, uint8_t *seen) {
+    memset(seen, 0, (size_t)(enemy_cap+1));
+    const int *heads = &w->heads[0][0];
+    for (int s=0; s<WHEEL_LEVELS*WHEEL_SLOTS; s++) {
+        int prev = -1;
+        for (int id=heads[s]; id != -1; id=timers[id].next) {
+            if (!in_range(id, 0, enemy_cap) || seen[id]) return false;
+            seen[id] = 1;
+            const Timer *t = &timers[id];
+            if (t->prev != prev || t->slot != s || t->kind == TIMER_NONE) return false;
+            prev = id;
+        }
+    }
+    for (int id=0; id<enemy_cap+1; id++) {
+        TimerKind kind = timers[id].kind;
+        if (id == TIMER_SPAWN) {
+            if (kind != TIMER_NONE && kind != TIMER_SPAWN_WAVE) return false;
+            continue;
+        }
+        uint8_t f = enemy_flags[id-1];
+        if (kind == TIMER_ENEMY_FIRE && !(f & ENEMY_ALIVE)) return false;
+        if ((kind == TIMER_ENEMY_DEATH) != ((f & ENEMY_DYING) != 0)) return false;
+        if (kind != TIMER_NONE && kind != TIMER_ENEMY_FIRE && kind != TIMER_ENEMY_DEATH) return false;
+        if (kind != TIMER_NONE && !seen[id]) return false;
+    }
+    return true;
+}
+
+/**
+ * Check the restored counters, pools and links against the capacities and
+ * each other, so a damaged or crafted file cannot send the pools or the
+ * wheel out of bounds. Runs once the pools point into the mapping, before
+ * anything is adopted.
+ */
+static bool suspend_state_valid(const SnapshotHeader *st) {
+    if (st->arena_bytes != arena.snapshot_bytes
+        || !in_range(st->tree_count, 0, prop_cap)
+        || !in_range(st->rock_count, 0, prop_cap)
+        || !in_range(st->wire_count, 0, prop_cap)
+        || !in_range(st->bullet_hi, 0, bullet_cap)
+        || !in_range(st->bullet_free_count, 0, bullet_cap)
+        || !in_range(st->enemy_hi, 0, enemy_cap)
+        || !in_range(st->enemy_free_count, 0, enemy_cap)) {
+        return false;
+    }
+    int most = bullet_cap > enemy_cap+1 ? bullet_cap : enemy_cap+1;
+    uint8_t *seen = malloc((size_t)most);
+    if (!seen) return false;
+    bool ok = pool_valid(bullet_pool.free, st->bullet_free_count, st->bullet_hi, bullet_cap,
+                         bullet_flags, BULLET_ALIVE, seen)
+        && pool_valid(enemy_pool.free, st->enemy_free_count, st->enemy_hi, enemy_cap,
+                      enemy_flags, ENEMY_ALIVE|ENEMY_DYING, seen)
+        && wheel_valid(&st->wheel, seen);
+    free(seen);
+    if (!ok) return false;
+    // the prop grid is static, but a bullet query walks it
+    if (prop_start[0] != 0 || prop_start[GRID_CELLS] > st->tree_count + st->rock_count) return false;
+    for (int c=0; c<GRID_CELLS; c++) {
+        if (prop_start[c+1] < prop_start[c]) return false;
+    }
+    for (int k=0; k<prop_start[GRID_CELLS]; k++) {
+        int item = prop_items[k];
+        if (item >= 0 ? item >= st->tree_count : ~item >= st->rock_count) return false;
+    }
+    return true;
+}
+
+static bool resume_round(const char *path) {
+    size_t size = 0;
+    unsigned char *m = map_file(path, &size);
+    if (!m) return false;
+
+    const SuspendHeader *h = (const SuspendHeader *)m;
+    uint32_t sizes[8];
+    suspend_sizes(sizes);
+    int scenario_count = (int)(sizeof(scenarios)/sizeof(scenarios[0]));
+    if (size < sizeof(*h) || h->magic != SUSPEND_MAGIC || h->version != SUSPEND_FORMAT
+        || memcmp(h->sizes, sizes, sizeof(sizes)) != 0
+        || h->scenario < 0 || h->scenario >= scenario_count
+        || h->dot_count < 0 || h->dot_count > MAX_BACKGROUND_DOTS
+        || h->bullet_cap < 1 || h->bullet_cap > MAX_POOL_CAPACITY
+        || h->enemy_cap < 1 || h->enemy_cap > MAX_POOL_CAPACITY
+        || h->prop_cap < 1 || h->prop_cap > MAX_POOL_CAPACITY
+        // offsets are checked against what is left, so they cannot wrap
+        || h->dots_offset % ARENA_ALIGN != 0 || h->arena_offset % ARENA_ALIGN != 0
+        || h->dots_offset < sizeof(*h) || h->dots_offset > size
+        || sizeof(Dot) * (size_t)h->dot_count > size - h->dots_offset
+        || h->arena_offset < sizeof(*h) || h->arena_offset > size
+        || h->arena_bytes > size - h->arena_offset) {
+        unmap_file(m, size);
+        return false;
+    }
+    const Dot *file_dots = (const Dot *)(m + h->dots_offset);
+    int tones = (int)(sizeof(dot_palette)/sizeof(dot_palette[0]));
+    for (int i=0; i<h->dot_count; i++) {
+        if (file_dots[i].tone >= tones) {
+            unmap_file(m, size);
+            return false;
+        }
+    }
+
+    int caps[3] = { bullet_cap, enemy_cap, prop_cap };
+    bullet_cap = h->bullet_cap;
+    enemy_cap = h->enemy_cap;
+    prop_cap = h->prop_cap;
+    if (round_bytes() != h->arena_bytes) {
+        bullet_cap = caps[0];
+        enemy_cap = caps[1];
+        prop_cap = caps[2];
+        unmap_file(m, size);
+        return false;
+    }
+
+    release_round();
+    arena.mapping = m;
+    arena.mapping_size = size;
+    arena.base = m + h->arena_offset;
+    arena.size = h->arena_bytes;
+    layout_round();
+    if (!suspend_state_valid(&h->state)) {
+        release_round(); // unmaps the file
+        bullet_cap = caps[0];
+        enemy_cap = caps[1];
+        prop_cap = caps[2];
+        return false;
+    }
+
+    scenario = &scenarios[h->scenario];
+    scale_horde();
+    dots = (Dot *)(m + h->dots_offset);
+    dot_count = h->dot_count;
+    restore_snapshot_header(&h->state);
+    return true;
+}
+
+/**
+ * One fixed netplay tick, restarts included, so rollback can replay it
+ */
+static void sim_tick(const InputBits *inputs) {
+    if (any_player_alive()) {
+        step_game(NUM(1.0f/NET_TICK_HZ), inputs);
+        return;
+    }
+    game_over = true;
+    for (int p=0; p<player_count; p++) {
+        if (inputs[p] & INPUT_RESTART) {
+            reset_game();
+            return;
+        }
+    }
+}
+
+/**
+ * Rollback
+ * Every tick runs on confirmed inputs where known, and otherwise predicts
+ * that a player keeps doing whatever they last did. The state before each
+ * tick is snapshotted. When a confirmed input contradicts a prediction,
+ * the state is restored to that tick and everything since is re-simulated.
+ * A peer that falls ROLLBACK_TICKS behind stalls the simulation instead.
+ */
+static bool rollback_init(void) {
+    free(rb.snapshots);
+    memset(&rb, 0, sizeof(rb));
+    rb.rollback_to = UINT32_MAX;
+    rb.snapshot_bytes = snapshot_size();
+    rb.snapshots = malloc(rb.snapshot_bytes * ROLLBACK_TICKS);
+    return rb.snapshots != NULL;
+}
+
+static void rollback_confirm(int p, uint32_t t, InputBits in) {
+    if (t != rb.known[p]) return; // duplicate, or a gap that redundancy will fill
+    if (t >= rb.tick + ROLLBACK_TICKS) return; // would overrun the ring
+    InputBits *slot = &rb.inputs[t % ROLLBACK_RING][p];
+    if (t < rb.tick && *slot != in && t < rb.rollback_to) rb.rollback_to = t;
+    *slot = in;
+    rb.known[p] = t+1;
+}
+
+static void rollback_simulate(uint32_t t) {
+    save_snapshot(rb.snapshots + (t % ROLLBACK_TICKS) * rb.snapshot_bytes);
+    InputBits *in = rb.inputs[t % ROLLBACK_RING];
+    for (int p=0; p<player_count; p++) {
+        if (t >= rb.known[p]) {
+            in[p] = rb.known[p] ? rb.inputs[(rb.known[p]-1) % ROLLBACK_RING][p] : 0;
+        }
+    }
+    sim_tick(in);
+}
+
+static void rollback_correct(void) {
+    if (rb.rollback_to >= rb.tick) {
+        rb.rollback_to = UINT32_MAX;
+        return;
+    }
+    uint64_t start = SDL_GetPerformanceCounter();
+    uint32_t from = rb.rollback_to;
+    load_snapshot(rb.snapshots + (from % ROLLBACK_TICKS) * rb.snapshot_bytes);
+    resimulating = true;
+    for (uint32_t t=from; t<rb.tick; t++) rollback_simulate(t);
+    resimulating = false;
+    double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+
+    rb.rollbacks++;
+    if ((int)(rb.tick - from) > rb.max_depth) rb.max_depth = (int)(rb.tick - from);
+    if (ms > rb.max_resim_ms) rb.max_resim_ms = ms;
+    rb.rollback_to = UINT32_MAX;
+}
+
+static void rollback_advance(double dt, int local, InputBits local_in) {
+    rb.accum += dt;
+    while (rb.accum >= 1.0/NET_TICK_HZ) {
+        uint32_t slowest = rb.tick;
+        for (int p=0; p<player_count; p++) {
+            if (p != local && rb.known[p] < slowest) slowest = rb.known[p];
+        }
+        if (rb.tick - slowest >= ROLLBACK_TICKS-1) {
+            // too far ahead of the peer to roll back safely: wait for it
+            rb.stalls++;
+            if (rb.accum > 0.25) rb.accum = 0.25;
+            return;
+        }
+        rb.accum -= 1.0/NET_TICK_HZ;
+        rb.inputs[rb.tick % ROLLBACK_RING][local] = local_in;
+        rb.known[local] = rb.tick+1;
+        rollback_simulate(rb.tick);
+        rb.tick++;
+    }
+}
+
+/**
+ * Netplay
+ * Two players exchange input over UDP, or with an in-process stand-in peer.
+ * Every datagram carries the sender's latest ROLLBACK_TICKS inputs, so a lost
+ * one is covered by the next. Outgoing datagrams can be delayed and dropped
+ * on purpose to test rollback under bad network conditions.
+ */
+static double net_now(void) {
+    return SDL_GetPerformanceCounter() / (double)SDL_GetPerformanceFrequency();
+}
+
+static void put_u32(Uint8 *p, uint32_t v) {
+    p[0] = (Uint8)(v >> 24); p[1] = (Uint8)(v >> 16); p[2] = (Uint8)(v >> 8); p[3] = (Uint8)v;
+}
+
+static uint32_t get_u32(const Uint8 *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/**
+ * Encode the last inputs of one player: magic, seed, config, first tick,
+ * count, then count 16-bit inputs, all big-endian
+ */
+static int net_encode(Uint8 *buf, const InputBits *history, uint32_t known) {
+    uint32_t first = known > ROLLBACK_TICKS ? known - ROLLBACK_TICKS : 0;
+    int count = (int)(known - first);
+    put_u32(buf, NET_MAGIC);
+    put_u32(buf + 4, net.seed);
+    put_u32(buf + 8, net.config);
+    put_u32(buf + 12, first);
+    buf[16] = (Uint8)count;
+    for (int i=0; i<count; i++) {
+        InputBits in = history[((first + i) % ROLLBACK_RING) * MAX_PLAYERS];
+        buf[17 + 2*i] = (Uint8)(in >> 8);
+        buf[18 + 2*i] = (Uint8)in;
+    }
+    return 17 + 2*count;
+}
+
+static uint32_t net_config(void) {
+    uint32_t h = 2166136261u; // FNV-1a over the settings that shape the round
+    uint32_t v[5] = { (uint32_t)bullet_cap, (uint32_t)enemy_cap, (uint32_t)prop_cap,
+                      (uint32_t)(scenario - scenarios), NUM_FRAC_BITS };
+    for (int i=0; i<5; i++) {
+        for (int b=0; b<4; b++) {
+            h ^= (v[i] >> (8*b)) & 0xFF;
+            h *= 16777619u;
+        }
+    }
+    return h;
+}
+
+static void net_start_round(void) {
+    rng_seed(net.seed);
+    reset_game();
+    if (!rollback_init()) {
+        SDL_Log("out of memory");
+        exit(1);
+    }
+    net.start = net_now();
+    net.connected = true;
+    fprintf(stderr, "net: peer connected, seed %u\n", net.seed);
+}
+
+static void net_receive_datagram(const Uint8 *buf, int len) {
+    if (len < 17 || get_u32(buf) != NET_MAGIC) return;
+    int count = buf[16];
+    if (len < 17 + 2*count) return;
+    if (get_u32(buf + 8) != net.config) {
+        fprintf(stderr, "net: peer uses different capacities or waves, ignoring\n");
+        return;
+    }
+    if (!net.connected) {
+        // the host's seed is authoritative: it starts on its own as soon as the
+        // joiner shows up, and the joiner takes the seed from the host's reply
+        if (net.mode != NET_HOST) net.seed = get_u32(buf + 4);
+        net_start_round();
+    }
+    uint32_t first = get_u32(buf + 12);
+    for (int i=0; i<count; i++) {
+        InputBits in = (InputBits)((buf[17 + 2*i] << 8) | buf[18 + 2*i]);
+        rollback_confirm(net.remote, first + (uint32_t)i, in);
     }
 }
 
 /**
- * Draw tree
+ * Queue a datagram behind the artificial delay, or lose it
  */
-static void draw_tree(SDL_Renderer *ren, int x, int y) {
-    SDL_SetRenderDrawColor(ren, 40, 25, 15, 255); // stump
-    draw_rect(ren, x-2, y-8, 4,16);
-    SDL_SetRenderDrawColor(ren, 50, 70, 40, 255); // canopy
-    draw_rect(ren, x-6, y-14, 12,8);
-    SDL_SetRenderDrawColor(ren, 100, 130, 80, 255); // highlight
-    draw_rect(ren, x-4, y-14, 4,4);
+static void net_queue(const Uint8 *buf, int len, bool to_local) {
+    net.sent++;
+    net.loss_rng ^= net.loss_rng << 13;
+    net.loss_rng ^= net.loss_rng >> 7;
+    net.loss_rng ^= net.loss_rng << 17;
+    if ((int)(net.loss_rng % 100) < net.loss_pct || net.queue_count == NET_QUEUE) {
+        net.lost++;
+        return;
+    }
+    NetDatagram *d = &net.queue[net.queue_count++];
+    memcpy(d->data, buf, (size_t)len);
+    d->len = len;
+    d->release = net_now() + net.delay_ms / 1000.0;
+    d->to_local = to_local;
 }
 
-/**
- * Draw rock
- */
-static void draw_rock(SDL_Renderer *ren, int x, int y) {
-    SDL_SetRenderDrawColor(ren, 80, 80, 80, 255); // dark base
-    draw_rect(ren, x-6, y-4, 12,8);
-    SDL_SetRenderDrawColor(ren, 140, 140, 140, 255); // highlight
-    draw_rect(ren, x-2, y-4, 4,3);
+#ifndef __EMSCRIPTEN__
+static bool net_open_socket(int port) {
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) return false;
+#endif
+    net.sock = socket(AF_INET, SOCK_DGRAM, 0);
+#ifdef _WIN32
+    if (net.sock == INVALID_SOCKET) return false;
+    u_long nonblocking = 1;
+    ioctlsocket(net.sock, FIONBIO, &nonblocking);
+#else
+    if (net.sock < 0) return false;
+    fcntl(net.sock, F_SETFL, fcntl(net.sock, F_GETFL, 0) | O_NONBLOCK);
+#endif
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((unsigned short)port);
+    return bind(net.sock, (struct sockaddr *)&addr, sizeof(addr)) == 0;
 }
 
-/**
- * Draw barbed wire
- */
-static void draw_wire(SDL_Renderer *ren, int x, int y) {
-    SDL_SetRenderDrawColor(ren, 150,150,150,255);
-    draw_rect(ren, x-10, y-1, 20,2);   // strand
-    draw_rect(ren, x-6,  y-5, 2,8);    // barb
-    draw_rect(ren, x+2,  y-5, 2,8);    // barb
+static bool net_resolve_peer(const char *host, int port) {
+    struct addrinfo hints, *res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(host, NULL, &hints, &res) != 0 || !res) return false;
+    memcpy(&net.peer, res->ai_addr, sizeof(net.peer));
+    net.peer.sin_port = htons((unsigned short)port);
+    freeaddrinfo(res);
+    net.have_peer = true;
+    return true;
+}
+#endif
+
+static bool net_init(NetMode mode, const char *host, int port, uint32_t seed) {
+    net.mode = mode;
+    net.seed = seed;
+    net.config = net_config();
+    net.loss_rng = 0x9E3779B97F4A7C15ULL;
+    player_count = 2;
+    show_welcome_msg = false;
+
+    // host and stand-in play as player 1; the joiner as player 2
+    net.local = mode == NET_JOIN ? 1 : 0;
+    net.remote = 1 - net.local;
+
+    if (mode == NET_LOOPBACK) {
+        net_start_round();
+        return true;
+    }
+#ifdef __EMSCRIPTEN__
+    (void)host; (void)port;
+    fprintf(stderr, "net: UDP is not available in the browser\n");
+    return false;
+#else
+    if (!net_open_socket(mode == NET_HOST ? port : 0)) {
+        fprintf(stderr, "net: cannot open UDP port %d\n", port);
+        return false;
+    }
+    if (mode == NET_JOIN && !net_resolve_peer(host, port)) {
+        fprintf(stderr, "net: cannot resolve %s\n", host);
+        return false;
+    }
+    // the world exists from the start, frozen until the peer shows up
+    rng_seed(net.seed);
+    reset_game();
+    fprintf(stderr, "net: %s on port %d\n", mode == NET_HOST ? "hosting" : "joining", port);
+    return true;
+#endif
 }
 
 /**
- * Draw all props at their randomized locations
+ * Loopback stand-in: plays a fixed pattern in real time, sending its inputs
+ * back through the same delay and loss, and waits on our inputs like a peer
  */
-static void draw_props(SDL_Renderer *ren) {
-    for (int i=0; i<prop_count; i++) {
-        if (!props[i].alive) continue;
-        int x = (int)props[i].x;
-        int y = (int)props[i].y;
-        switch (props[i].kind) {
-            case PROP_TREE: draw_tree(ren, x, y); break;
-            case PROP_ROCK: draw_rock(ren, x, y); break;
-            case PROP_WIRE: draw_wire(ren, x, y); break;
+static InputBits standin_input(uint32_t t) {
+    static const InputBits moves[] = {
+        INPUT_MOVE_UP, INPUT_MOVE_UP | INPUT_MOVE_RIGHT, INPUT_MOVE_RIGHT,
+        INPUT_MOVE_DOWN | INPUT_MOVE_RIGHT, INPUT_MOVE_DOWN, INPUT_MOVE_DOWN | INPUT_MOVE_LEFT,
+        INPUT_MOVE_LEFT, INPUT_MOVE_UP | INPUT_MOVE_LEFT, 0
+    };
+    InputBits in = moves[(t / 45) % 9];
+    in |= (InputBits)(INPUT_FIRE_UP << ((t / 20) % 4));
+    return in | INPUT_RESTART;
+}
+
+static void standin_play(void) {
+    static InputBits history[ROLLBACK_RING][MAX_PLAYERS];
+    uint32_t due = (uint32_t)((net_now() - net.start) * NET_TICK_HZ);
+    while (net.standin_tick < due && net.standin_tick < net.standin_seen + ROLLBACK_TICKS-1) {
+        history[net.standin_tick % ROLLBACK_RING][0] = standin_input(net.standin_tick);
+        net.standin_tick++;
+    }
+    Uint8 buf[NET_PACKET_MAX];
+    net_queue(buf, net_encode(buf, &history[0][0], net.standin_tick), true);
+}
+
+static void net_pump(void) {
+    double now = net_now();
+    for (int i=0; i<net.queue_count; ) {
+        NetDatagram *d = &net.queue[i];
+        if (d->release > now) { i++; continue; }
+        if (net.mode == NET_LOOPBACK) {
+            if (d->to_local) {
+                net_receive_datagram(d->data, d->len);
+            } else {
+                uint32_t known = get_u32(d->data + 12) + d->data[16];
+                if (known > net.standin_seen) net.standin_seen = known;
+            }
+        }
+#ifndef __EMSCRIPTEN__
+        else if (net.have_peer) {
+            sendto(net.sock, (const char *)d->data, d->len, 0,
+                (struct sockaddr *)&net.peer, sizeof(net.peer));
+        }
+#endif
+        *d = net.queue[--net.queue_count];
+    }
+
+#ifndef __EMSCRIPTEN__
+    if (net.mode == NET_HOST || net.mode == NET_JOIN) {
+        Uint8 buf[NET_PACKET_MAX];
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int len;
+        while ((len = (int)recvfrom(net.sock, (char *)buf, sizeof(buf), 0,
+                (struct sockaddr *)&from, &from_len)) > 0) {
+            if (net.mode == NET_HOST && !net.have_peer) {
+                net.peer = from; // first datagram tells the host where the joiner is
+                net.have_peer = true;
+            }
+            net_receive_datagram(buf, len);
+            from_len = sizeof(from);
         }
     }
+#endif
 }
 
 /**
- * Draw the background dots
+ * Netplay frame: receive, fix mispredictions, run due ticks, send
  */
-static void draw_dots(SDL_Renderer *ren) {
-    for (int i=0; i<dot_count; i++) {
-        SDL_SetRenderDrawColor(ren, dots[i].r, dots[i].g, dots[i].b, 255);
-        // draw a 1-2 pixel speckle
-        // tiny jitter to avoid perfect squares
-        draw_rect(ren, dots[i].x, dots[i].y, 2, 2);
+static void net_update(double dt, InputBits local_in) {
+    net_pump();
+    if (net.mode == NET_LOOPBACK) standin_play();
+
+    if (net.connected) {
+        rollback_correct();
+        rollback_advance(dt, net.local, local_in);
     }
+
+    Uint8 buf[NET_PACKET_MAX];
+    uint32_t known = net.connected ? rb.known[net.local] : 0; // a bare hello until then
+    net_queue(buf, net_encode(buf, &rb.inputs[0][net.local], known), false);
+    net_pump();
 }
 
-/**
- * get pixel width of a string
- */
-static int get_text_width(const char *msg) {
-    int w = 0;
-    for (const char *p = msg; *p; p++) {
-        w += 6*FONT_SCALE; // 5 wide + 1 pixel gap
+static void net_close(void) {
+    if (net.mode == NET_OFF) return;
+    fprintf(stderr, "net: %d ticks, %d rollbacks (deepest %d ticks, slowest %.3f ms), "
+        "%d stalls, %d/%d datagrams lost\n", (int)rb.tick, rb.rollbacks, rb.max_depth,
+        rb.max_resim_ms, rb.stalls, net.lost, net.sent);
+#ifndef __EMSCRIPTEN__
+    if (net.mode == NET_HOST || net.mode == NET_JOIN) {
+#ifdef _WIN32
+        closesocket(net.sock);
+        WSACleanup();
+#else
+        close(net.sock);
+#endif
     }
-    return w;
+#endif
+    free(rb.snapshots);
+    rb.snapshots = NULL;
 }
 
 /**
- * draw text centered around (cx, cy)
+ * Simulation step
+ * One frame of the local game: restart if asked, then play while anyone is
+ * alive and the game is not paused. The window and headless loops hand it
+ * over through sim_post, which runs it right away, or on the worker.
  */
-static void draw_text_centered(SDL_Renderer *ren, int cx, int cy, const char *msg, SDL_Color color) {
-    int w = get_text_width(msg);
-    int h = 5*FONT_SCALE; // glyphs are 5 high, line gap is up to cy
-    int x = cx - w / 2;
-    int y = cy - h / 2;
-    draw_text(ren, x, y, msg, color);
+static void sim_run(const SimJob *job) {
+    if (job->restart) reset_game();
+    if (any_player_alive() && !job->paused) {
+        InputBits inputs[MAX_PLAYERS] = { 0 };
+        for (int p=0; p<player_count; p++) {
+            inputs[p] = bot ? bot_input(p) : p == 0 ? job->input : 0;
+        }
+        step_game(job->dt, inputs);
+    } else if (!any_player_alive()) {
+        game_over = true;
+    }
 }
 
 /**
- * Render graphics
+ * Simulation thread
+ * With TOMMY_SIM_THREAD, which pthread builds for the browser turn on, the
+ * world is thread local and a worker owns the live one. Each finished step
+ * goes into one of two frames; the main thread draws the front one while
+ * the worker runs the next step and writes the back one. sim_collect waits
+ * for the step in flight, which has had a whole frame to finish, swaps the
+ * frames and points this thread's pools at the new front, with no copy;
+ * then it plays the effects the step asked for. sim_post hands over the
+ * next step. A frame therefore shows the step posted one frame earlier,
+ * and the latency report counts that frame. The worker runs exactly the
+ * jobs the single threaded loop would, so the game plays out the same.
  */
-static void render(SDL_Renderer *ren) {
-    SDL_SetRenderDrawColor(ren, 45, 35, 25, 255); // base muddy ground
-    SDL_RenderClear(ren);
-    draw_dots(ren);
-    draw_props(ren);
+#ifdef TOMMY_SIM_THREAD
+// copy this thread's world into a frame: the snapshot part, or all of it for a new round
+static bool sim_publish(SimFrame *f) {
+    bool whole = !f->base || f->header.round_id != round_id || f->bullet_cap != bullet_cap
+        || f->enemy_cap != enemy_cap || f->prop_cap != prop_cap;
+    if (f->size != arena.size) {
+        free(f->base);
+        f->base = malloc(arena.size);
+        f->size = f->base ? arena.size : 0;
+        if (!f->base) return false;
+        whole = true;
+    }
+    fill_snapshot_header(&f->header);
+    f->bullet_cap = bullet_cap;
+    f->enemy_cap = enemy_cap;
+    f->prop_cap = prop_cap;
+    f->horde_scale = horde_scale;
+    f->win_time = win_time;
+    if (whole) {
+        memcpy(f->base, arena.base, arena.size);
+        memcpy(f->dots, dots, sizeof(Dot) * dot_count);
+        f->dot_count = dot_count;
+    } else {
+        memcpy(f->base, arena.base, arena.snapshot_bytes);
+    }
+    return true;
+}
 
-    // draw enemy blood
-    for (int i=0;i<MAX_ENEMIES;i++) {
-        Enemy *e = &enemies[i];
-        if (!e->alive && e->death_timer > 0.0f) {
-            SDL_SetRenderDrawColor(ren, 140, 0, 0, 255);
-            draw_filled_circle(ren, (int)e->x, (int)e->y, 10);
-        }
+// point this thread's world at a frame, which stays owned by the frame
+static void sim_show(SimFrame *f) {
+    restore_snapshot_header(&f->header);
+    bullet_cap = f->bullet_cap;
+    enemy_cap = f->enemy_cap;
+    prop_cap = f->prop_cap;
+    horde_scale = f->horde_scale;
+    win_time = f->win_time;
+    arena.base = f->base;
+    arena.size = f->size;
+    layout_round();
+    dots = f->dots;
+    dot_count = f->dot_count;
+}
+
+// give this thread a world of its own, copied from a frame
+static bool sim_take(const SimFrame *f) {
+    bullet_cap = f->bullet_cap;
+    enemy_cap = f->enemy_cap;
+    prop_cap = f->prop_cap;
+    memset(&arena, 0, sizeof(arena));
+    if (!alloc_round()) return false;
+    restore_snapshot_header(&f->header);
+    horde_scale = f->horde_scale;
+    win_time = f->win_time;
+    memcpy(arena.base, f->base, arena.size);
+    memcpy(dot_storage, f->dots, sizeof(Dot) * f->dot_count);
+    dots = dot_storage;
+    dot_count = f->dot_count;
+    return true;
+}
+
+static int sim_worker(void *arg) {
+    (void)arg;
+    on_sim_worker = true;
+    SDL_LockMutex(sim.lock);
+    // take over the round the main thread set up
+    sim.failed = !sim_take(&sim.frames[sim.front]);
+    sim.busy = false;
+    SDL_CondBroadcast(sim.cond);
+    while (!sim.failed) {
+        while (!sim.busy && !sim.quit) SDL_CondWait(sim.cond, sim.lock);
+        if (sim.quit) break;
+        SimJob job = sim.job;
+        SimFrame *back = &sim.frames[1 - sim.front];
+        SDL_UnlockMutex(sim.lock);
+        sim_run(&job);
+        bool ok = sim_publish(back);
+        SDL_LockMutex(sim.lock);
+        sim.failed = !ok;
+        sim.fresh = true;
+        sim.busy = false;
+        SDL_CondBroadcast(sim.cond);
     }
+    SDL_UnlockMutex(sim.lock);
+    release_round();
+    return 0;
+}
+#endif
 
-    // draw enemies alive
-    for (int i=0;i<MAX_ENEMIES;i++) {
-        Enemy *e = &enemies[i];
-        if (e->alive) {
-            draw_soldier(ren, (int)e->x, (int)e->y, false);
+// move the simulation to a worker, if this build has one
+static void sim_start(void) {
+#ifdef TOMMY_SIM_THREAD
+    sim.lock = SDL_CreateMutex();
+    sim.cond = SDL_CreateCond();
+    sim.front = 0;
+    if (sim.lock && sim.cond && sim_publish(&sim.frames[0])) {
+        sim.busy = true; // until the worker has taken its copy
+        sim.thread = SDL_CreateThread(sim_worker, "simulation", NULL);
+    }
+    if (sim.thread) {
+        SDL_LockMutex(sim.lock);
+        while (sim.busy) SDL_CondWait(sim.cond, sim.lock);
+        SDL_UnlockMutex(sim.lock);
+        if (sim.failed) {
+            SDL_WaitThread(sim.thread, NULL);
+            sim.thread = NULL;
         }
     }
+    if (!sim.thread) {
+        SDL_Log("cannot start the simulation thread, simulating on the main thread");
+        if (sim.cond) SDL_DestroyCond(sim.cond);
+        if (sim.lock) SDL_DestroyMutex(sim.lock);
+        free(sim.frames[0].base);
+        memset(&sim, 0, sizeof(sim));
+        return;
+    }
+    // the worker has its own copy now; draw from the frames from here on
+    release_round();
+    sim_show(&sim.frames[0]);
+    fprintf(stderr, "simulating on a worker thread\n");
+#endif
+}
 
-    // draw bullets
-    for (int i=0;i<MAX_BULLETS;i++) {
-        if (!bullets[i].alive) continue;
-        if (bullets[i].from_enemy) {
-            SDL_SetRenderDrawColor(ren, 200, 60, 40, 255); // enemy tracer
-        } else {
-            SDL_SetRenderDrawColor(ren, 240, 220, 80, 255); // player tracer
+// wait for the step in flight and show it
+static void sim_collect(void) {
+#ifdef TOMMY_SIM_THREAD
+    if (!sim.thread) return;
+    SDL_LockMutex(sim.lock);
+    while (sim.busy) SDL_CondWait(sim.cond, sim.lock);
+    if (sim.failed) {
+        SDL_Log("out of memory");
+        exit(1);
+    }
+    if (sim.fresh) {
+        sim.front = 1 - sim.front;
+        sim_show(&sim.frames[sim.front]);
+        sim.fresh = false;
+        for (int i=0; i<sim.emit_count; i++) {
+            const EmitRequest *r = &sim.emits[i];
+            emit(r->em, r->x, r->y, r->dx, r->dy);
         }
-        draw_rect(ren, (int)bullets[i].x-2, (int)bullets[i].y-2, 4,4);
+        sim.emit_count = 0;
     }
+    SDL_UnlockMutex(sim.lock);
+#endif
+}
 
-    // draw player
-    if (player.alive) {
-        draw_soldier(ren, (int)player.x, (int)player.y, true);
+static void sim_post(const SimJob *job) {
+#ifdef TOMMY_SIM_THREAD
+    if (sim.thread) {
+        SDL_LockMutex(sim.lock);
+        sim.job = *job;
+        sim.busy = true;
+        SDL_CondBroadcast(sim.cond);
+        SDL_UnlockMutex(sim.lock);
+        return;
+    }
+#endif
+    sim_run(job);
+}
 
-        // rifle direction marker
-        float dx = player.aimx;
-        float dy = player.aimy;
-        if (fabsf(dx) < 0.001f && fabsf(dy) < 0.001f) {
-            dx = 0.0f; dy = -1.0f;
-        }
-        normalize(&dx,&dy);
-        int gunx = (int)(player.x + dx*12.0f);
-        int guny = (int)(player.y + dy*12.0f);
+// a step is shown one frame after it was posted
+static bool sim_pipelined(void) {
+#ifdef TOMMY_SIM_THREAD
+    return sim.thread != NULL;
+#else
+    return false;
+#endif
+}
 
-        SDL_SetRenderDrawColor(ren, 90, 56 ,34, 255); // outer 'woody' color
-        draw_rect(ren, gunx-3, guny-3, 6,6);
+// bring the last step back to this thread, which owns the world again
+static void sim_stop(void) {
+#ifdef TOMMY_SIM_THREAD
+    if (!sim.thread) return;
+    sim_collect();
+    SDL_LockMutex(sim.lock);
+    sim.quit = true;
+    SDL_CondBroadcast(sim.cond);
+    SDL_UnlockMutex(sim.lock);
+    SDL_WaitThread(sim.thread, NULL);
+    SDL_DestroyCond(sim.cond);
+    SDL_DestroyMutex(sim.lock);
+    if (!sim_take(&sim.frames[sim.front])) {
+        SDL_Log("out of memory");
+        exit(1);
+    }
+    free(sim.frames[0].base);
+    free(sim.frames[1].base);
+    memset(&sim, 0, sizeof(sim));
+#endif
+}
 
-        SDL_SetRenderDrawColor(ren, 140, 140, 140, 255); // inner 'metal' color
-        draw_rect(ren, gunx-2, guny-2, 4,4);
-    } else {
-        if (game_won){
-        	SDL_SetRenderDrawColor(ren, 0, 0, 0, 255);
-        	draw_rect(ren, 0, 0, SCREEN_W, SCREEN_H);
-        }else{
-        	SDL_SetRenderDrawColor(ren, 180, 0, 0, 255);
-        	draw_filled_circle(ren, (int)player.x, (int)player.y, 14);
-        }
+/**
+ * Late latching
+ * Instead of sampling input right after the last present and then blocking
+ * a whole refresh in the next one, sleep first and sample as late as the
+ * recent frames allow: the slowest of the last LATCH_HISTORY frames, from
+ * sampling to handing the frame over, plus a margin must still fit before
+ * the refresh. Input arriving during the wait is pumped as it comes, so
+ * SDL stamps it close to when it happened.
+ */
+static void latch_init(void) {
+    SDL_DisplayMode mode;
+    int hz = 60;
+    if (SDL_GetWindowDisplayMode(win, &mode) == 0 && mode.refresh_rate > 0) hz = mode.refresh_rate;
+    // the nearest refresh at or above 60 fps, as the frame limiter would pace it
+    int every = hz / 60 > 0 ? hz / 60 : 1;
+    latch.period = (double)every / hz;
+}
+
+static void latch_wait(void) {
+    if (!latch.enabled || !latch.last_present) return;
+    float worst = 0.0f;
+    for (int i=0; i<LATCH_HISTORY; i++) {
+        if (latch.work[i] > worst) worst = latch.work[i];
+    }
+    double lead = latch.period - worst - LATCH_MARGIN_SEC;
+    if (lead <= 0.0) return;
+    uint64_t deadline = latch.last_present + (uint64_t)(lead * freq);
+    uint64_t now;
+    while ((now = SDL_GetPerformanceCounter()) < deadline) {
+        SDL_PumpEvents();
+        // sleep in whole milliseconds while there is room, spin the rest
+        if ((deadline - now) / freq > 0.002) SDL_Delay(1);
     }
+}
 
-    SDL_Color fontcol = {255, 220, 180, 255};
+static void latch_record(uint64_t sampled, uint64_t work_end, uint64_t presented) {
+    latch.work[latch.next] = (float)((work_end - sampled) / freq);
+    latch.next = (latch.next + 1) % LATCH_HISTORY;
+    latch.last_present = presented;
+}
 
-    // timer
-    {
-        char buf[64];
-        snprintf(buf, sizeof(buf), "TIME %.1f", survival_time);
-        draw_text(ren, 10, 10, buf, fontcol);
+/**
+ * Input latency
+ * For every key press or release, the time from the SDL event timestamp to
+ * the return of the present that first showed its effect, in a histogram of
+ * 1 ms buckets printed at exit.
+ */
+static void latency_note(const SDL_Event *ev) {
+    if (!latency.enabled) return;
+    if (ev->type != SDL_KEYDOWN && ev->type != SDL_KEYUP) return;
+    if (ev->key.repeat) return;
+    if (latency.pending_count < LATENCY_PENDING) latency.pending[latency.pending_count++] = ev->key.timestamp;
+}
+
+static void latency_count(const uint32_t *stamps, int n, uint32_t now) {
+    for (int i=0; i<n; i++) {
+        uint32_t ms = now - stamps[i];
+        latency.buckets[ms < LATENCY_BUCKETS ? ms : LATENCY_BUCKETS-1]++;
+        latency.count++;
+        latency.sum_ms += ms;
+        if (ms > latency.max_ms) latency.max_ms = ms;
     }
-    
-    // pause
-    if (paused) {
-        SDL_Color pause_color = {255, 255, 255, 255};
-        if(show_welcome_msg) {
-            draw_text_centered(ren, CENTER_W, CENTER_H-210, "##################", fontcol);
-            draw_text_centered(ren, CENTER_W, CENTER_H-180, "# THE LOST TOMMY #", fontcol);
-            draw_text_centered(ren, CENTER_W, CENTER_H-150, "##################", fontcol);
-            draw_text_centered(ren, CENTER_W, CENTER_H-30, "MOVE: W A S D", fontcol);
-            draw_text_centered(ren, CENTER_W, CENTER_H+30, "FIRE: I J K L", fontcol);
-            draw_text_centered(ren, CENTER_W, CENTER_H+90, "START/PAUSE: SPACEBAR", fontcol);
-            draw_text_centered(ren, CENTER_W, CENTER_H+150, "TOGGLE FULLSCREEN: F1", fontcol);
-            draw_text_centered(ren, CENTER_W, CENTER_H+210, "QUIT: ESC", fontcol);
-        } else {
-            draw_text_centered(ren, CENTER_W, CENTER_H-30, "GAME IS PAUSED", fontcol);
-            draw_text_centered(ren, CENTER_W, CENTER_H+30, "PRESS SPACEBAR TO RESUME", fontcol);
-        }
+}
+
+static void latency_presented(void) {
+    uint32_t now = SDL_GetTicks();
+    if (sim_pipelined()) {
+        // this present showed the step posted last frame; this frame's input shows next time
+        latency_count(latency.in_flight, latency.in_flight_count, now);
+        memcpy(latency.in_flight, latency.pending, sizeof(uint32_t) * latency.pending_count);
+        latency.in_flight_count = latency.pending_count;
+    } else {
+        latency_count(latency.pending, latency.pending_count, now);
     }
+    latency.pending_count = 0;
+}
 
-    // game over message
-    if (game_over) {
-        if (game_won) {
-            draw_text_centered(ren, CENTER_W, CENTER_H-30, "YOU SURVIVED!", fontcol);
-        } else {
-            draw_text_centered(ren, CENTER_W, CENTER_H-30, "YOU DIED!", fontcol);
-        }
-        draw_text_centered(ren, CENTER_W, CENTER_H+30, "PRESS SPACEBAR TO PLAY AGAIN", fontcol);
-	}
+static uint32_t latency_percentile(uint32_t pct) {
+    uint32_t want = (latency.count * pct + 99) / 100, seen = 0;
+    for (uint32_t b=0; b<LATENCY_BUCKETS; b++) {
+        seen += latency.buckets[b];
+        if (seen >= want) return b;
+    }
+    return LATENCY_BUCKETS-1;
+}
 
-    SDL_RenderPresent(ren);
+static void latency_report(void) {
+    if (!latency.enabled) return;
+    fprintf(stderr, "input latency%s: %u events", latch.enabled ? " (late latch)" : "", latency.count);
+    if (latency.count == 0) {
+        fprintf(stderr, "\n");
+        return;
+    }
+    fprintf(stderr, ", mean %.1f ms, p50 %u ms, p95 %u ms, p99 %u ms, max %u ms\n",
+        (double)latency.sum_ms / latency.count, latency_percentile(50),
+        latency_percentile(95), latency_percentile(99), latency.max_ms);
+    uint32_t first = 0, last = LATENCY_BUCKETS-1, peak = 0;
+    while (latency.buckets[first] == 0) first++;
+    while (latency.buckets[last] == 0) last--;
+    for (uint32_t b=first; b<=last; b++) {
+        if (latency.buckets[b] > peak) peak = latency.buckets[b];
+    }
+    for (uint32_t b=first; b<=last; b++) {
+        char bar[41];
+        int n = (int)(latency.buckets[b] * 40 / peak);
+        memset(bar, '#', (size_t)n);
+        bar[n] = '\0';
+        fprintf(stderr, "  %s%3u ms %-40s %u\n", b == LATENCY_BUCKETS-1 ? ">=" : "  ",
+            b, bar, latency.buckets[b]);
+    }
 }
 
 static void update_game(void *arg) {
     SDL_Renderer *ren = (SDL_Renderer *)arg;
 
+    latch_wait();
+
     // start counting how long it takes to render 1 frame
     uint64_t frame_start = SDL_GetPerformanceCounter();
 
+    bool restart = false;
     SDL_Event ev;
     while (SDL_PollEvent(&ev)) {
+        latency_note(&ev);
         if (ev.type == SDL_QUIT) running = false;
         if (ev.type == SDL_KEYDOWN) {
             if (ev.key.keysym.sym == SDLK_ESCAPE) {
                 running = false;
             }
-            else if (ev.key.keysym.sym == SDLK_SPACE) {
-                if (!player.alive) {
+            else if (ev.key.keysym.sym == SDLK_SPACE && net.mode == NET_OFF) {
+                // in netplay SPACE is part of the input sent to the peer
+                if (!any_player_alive()) {
                     // when game over, SPACE restarts
-                    reset_game();
+                    restart = true;
+                    paused = show_welcome_msg;
                 } else {
                     // when alive, SPACE pauses/unpauses
                     paused = !paused;
@@ -901,6 +3848,7 @@ static void update_game(void *arg) {
     // timing
     uint64_t now = SDL_GetPerformanceCounter();
     double dt = (now - prev) / freq;
+    double frame_interval = dt;
     prev = now;
 
     // delta frame time clamp
@@ -909,32 +3857,30 @@ static void update_game(void *arg) {
     // overshooting, teleporting, missed collisions, etc
     if (dt > 0.05) dt = 0.05;
 
-    if (player.alive && !paused) {
-        control_player((float)dt, keys);
-        move_bullets((float)dt);
-        move_enemies((float)dt);
-        handle_props_effects();
-        handle_bullet_actor_collisions();
-
-        // spawn enemies every 1.0 second
-        enemy_spawn_timer -= (float)dt;
-        if (enemy_spawn_timer <= 0.0f) {
-            spawn_enemy();
-            enemy_spawn_timer = 1.0f;
-        }
-
-        // survival timer
-        survival_time += (float)dt;
-        if (!game_won && survival_time >= WIN_TIME) {
-            survival_time = WIN_TIME; // clamp
-            game_won = true;
-            player.alive = false; // end the round
-       }
-    } else if (!player.alive) {
-        game_over = true;
+    if (net.mode != NET_OFF) {
+        net_update(dt, bot ? bot_input(net.local) : input_from_keys(keys));
+    } else {
+        // with a worker, this shows the step posted last frame while it runs this one
+        sim_collect();
+        SimJob job = { num_from_float((float)dt), input_from_keys(keys), paused, restart };
+        sim_post(&job);
     }
+    if (!paused) particles_update((float)dt);
 
     render(ren);
+    finish_frame(ren);
+
+    // frame cost before present, which may block on vsync
+    uint64_t work_end = SDL_GetPerformanceCounter();
+    SDL_RenderPresent(ren);
+    uint64_t presented = SDL_GetPerformanceCounter();
+    latency_presented();
+    govern_quality((float)((work_end - frame_start) / freq), (float)frame_interval);
+    if (latch.enabled) {
+        // the wait before sampling paces the frames instead
+        latch_record(frame_start, work_end, presented);
+        return;
+    }
 
     // add delay to limit frames to exactly 60 fps (or less..)
     #ifndef __EMSCRIPTEN__
@@ -949,12 +3895,295 @@ static void update_game(void *arg) {
     #endif
 }
 
+/**
+ * Headless loop
+ * Simulates at a fixed 1/60 s step without a window, as fast as possible.
+ * With a capture path every frame is rendered into the software framebuffer
+ * and written out; without one it is a soak run that renders unless asked
+ * not to and reports throughput along the way. Rounds restart on their own
+ * after a short game over screen.
+ */
+static bool pools_consistent(void) {
+    int live = 0;
+    for (int b=0; b<bullet_pool.hi; b++) {
+        if (bullet_flags[b] & BULLET_ALIVE) live++;
+    }
+    if (live != bullet_cap - bullet_pool.free_count) return false;
+    live = 0;
+    for (int e=0; e<enemy_pool.hi; e++) {
+        if (enemy_flags[e] & (ENEMY_ALIVE|ENEMY_DYING)) live++;
+    }
+    return live == enemy_cap - enemy_pool.free_count;
+}
+
+static int run_headless(const char *capture_path, int frames, bool draw, FILE *hash_log) {
+    soft_fb = malloc(sizeof(uint32_t) * SCREEN_W * SCREEN_H);
+    if (!soft_fb) return 1;
+    FrameCapture cap;
+    if (capture_path && !capture_open(&cap, capture_path)) {
+        capture_close(&cap);
+        free_soft_render();
+        return 1;
+    }
+
+    show_welcome_msg = false;
+    reset_game();
+    sim_start();
+
+    uint64_t start = SDL_GetPerformanceCounter();
+    uint64_t report_start = start;
+    int report_every = frames / SOAK_REPORTS > 0 ? frames / SOAK_REPORTS : 1;
+    int game_over_frames = 0;
+    int rounds = 1, wins = 0, peak_bullets = 0, peak_enemies = 0, peak_particles = 0;
+    long long bullet_ticks = 0;
+    float longest = 0.0f;
+    bool consistent = true;
+    for (int f=0; f<frames; f++) {
+        bool alive = any_player_alive();
+        SimJob job = { NUM(1.0f/CAPTURE_FPS), 0, false, false };
+        if (!alive && ++game_over_frames > CAPTURE_GAME_OVER_FRAMES) {
+            game_over_frames = 0;
+            if (game_won) wins++;
+            if (num_to_float(survival_time) > longest) longest = num_to_float(survival_time);
+            consistent = consistent && pools_consistent();
+            rounds++;
+            // this frame only starts the new round, it does not step it
+            job.restart = true;
+            job.paused = true;
+        }
+        // every step is collected before the frame is drawn, so each one is seen
+        sim_post(&job);
+        sim_collect();
+        if (alive) {
+            int live = bullet_cap - bullet_pool.free_count;
+            if (live > peak_bullets) peak_bullets = live;
+            if (enemy_cap - enemy_pool.free_count > peak_enemies) peak_enemies = enemy_cap - enemy_pool.free_count;
+            bullet_ticks += live;
+        }
+        particles_update(1.0f/CAPTURE_FPS);
+        if (fx.live > peak_particles) peak_particles = fx.live;
+        if (hash_log) fprintf(hash_log, "%d %08x\n", f, state_hash());
+        if (capture_path || draw) render(NULL);
+        if (capture_path) capture_push(&cap, soft_fb);
+
+        if (!capture_path && (f+1) % report_every == 0) {
+            uint64_t now = SDL_GetPerformanceCounter();
+            double secs = (now - report_start) / (double)SDL_GetPerformanceFrequency();
+            report_start = now;
+            fprintf(stderr, "tick %d: %.0f ticks/s, round %d, %d bullets, %d enemies\n",
+                f+1, report_every / (secs > 0.0 ? secs : 1.0), rounds,
+                bullet_cap - bullet_pool.free_count, enemy_cap - enemy_pool.free_count);
+        }
+    }
+    sim_stop();
+    bool ok = capture_path ? capture_close(&cap) : true;
+    double secs = (SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+    consistent = consistent && pools_consistent();
+
+    if (capture_path && !ok) {
+        fprintf(stderr, "capture to %s failed after %d of %d frames\n", capture_path, cap.written, frames);
+    } else if (capture_path) {
+        fprintf(stderr, "captured %d frames to %s in %.2f s (%.0f fps, %d queue stalls)\n",
+            frames, capture_path, secs, frames / (secs > 0.0 ? secs : 1.0), cap.stalls);
+    } else {
+        if (num_to_float(survival_time) > longest) longest = num_to_float(survival_time);
+        fprintf(stderr, "soak: %d ticks in %.2f s (%.0f ticks/s), bot %s\n",
+            frames, secs, frames / (secs > 0.0 ? secs : 1.0), bot ? bot->name : "none");
+        fprintf(stderr, "soak: %d rounds, %d won, longest %.1f s\n", rounds, wins, longest);
+        fprintf(stderr, "soak: peak %d bullets, %d enemies, %d particles, %.1f bullets on average\n",
+            peak_bullets, peak_enemies, peak_particles, frames > 0 ? (double)bullet_ticks / frames : 0.0);
+        fprintf(stderr, "soak: pools %s\n", consistent ? "consistent" : "LEAKED SLOTS");
+    }
+    fprintf(stderr, "%s state hash %08x (%s)\n", capture_path ? "final" : "soak: final",
+        state_hash(), NUM_FRAC_BITS ? "16.16 fixed point" : "float");
+    free_soft_render();
+    return ok && consistent ? 0 : 1;
+}
+
+/**
+ * Memory report
+ * Bytes per subsystem at the current capacities, to check how much of a
+ * horde fits in cache. The hot set is what every tick walks end to end when
+ * the pools are full: bullets, enemy positions and velocities, their flags
+ * and the neighbour grid.
+ */
+static void mem_line(const char *name, size_t bytes, size_t per_slot) {
+    if (per_slot) {
+        fprintf(stderr, "  %-24s %12zu bytes  (%zu per slot)\n", name, bytes, per_slot);
+    } else {
+        fprintf(stderr, "  %-24s %12zu bytes\n", name, bytes);
+    }
+}
+
+static void mem_report(void) {
+    size_t bullet_bytes = arena_size(sizeof(Bullet) * bullet_cap);
+    size_t bullet_flag_bytes = arena_size(sizeof(uint8_t) * bullet_cap);
+    size_t enemy_bytes = arena_size(sizeof(Enemy) * enemy_cap);
+    size_t enemy_flag_bytes = arena_size(sizeof(uint8_t) * enemy_cap);
+    size_t free_bytes = arena_size(sizeof(int) * bullet_cap) + arena_size(sizeof(int) * enemy_cap);
+    size_t timer_bytes = arena_size(sizeof(Timer) * (enemy_cap+1));
+    size_t tree_bytes = arena_size(sizeof(Tree) * prop_cap);
+    size_t spot_bytes = 2 * arena_size(sizeof(PropSpot) * prop_cap);
+    size_t wire_bytes = arena_size(sizeof(uint32_t) * WIRE_WORDS * SCREEN_H);
+    size_t prop_grid_bytes = arena_size(sizeof(int) * (GRID_CELLS+1)) + arena_size(sizeof(int) * prop_cap);
+    size_t grid_bytes = arena_size(sizeof(int) * (GRID_CELLS+1)) + 2 * arena_size(sizeof(int) * enemy_cap);
+    size_t snapshot_bytes = sizeof(SnapshotHeader) + bullet_bytes + bullet_flag_bytes + enemy_bytes
+        + enemy_flag_bytes + free_bytes + timer_bytes + tree_bytes;
+    size_t hot_bytes = bullet_bytes + bullet_flag_bytes + enemy_bytes + enemy_flag_bytes + grid_bytes;
+
+    fprintf(stderr, "memory at %d bullets, %d enemies, %d props:\n", bullet_cap, enemy_cap, prop_cap);
+    mem_line("bullets", bullet_bytes, sizeof(Bullet));
+    mem_line("bullet flags", bullet_flag_bytes, sizeof(uint8_t));
+    mem_line("enemies", enemy_bytes, sizeof(Enemy));
+    mem_line("enemy flags", enemy_flag_bytes, sizeof(uint8_t));
+    mem_line("pool free lists", free_bytes, 0);
+    mem_line("timers", timer_bytes, sizeof(Timer));
+    mem_line("trees", tree_bytes, sizeof(Tree));
+    mem_line("rocks and wire", spot_bytes, sizeof(PropSpot));
+    mem_line("wire bitmap", wire_bytes, 0);
+    mem_line("prop grid", prop_grid_bytes, 0);
+    mem_line("neighbour grid", grid_bytes, 0);
+    mem_line("round arena", round_bytes(), 0);
+    mem_line("background dots", sizeof(Dot) * MAX_BACKGROUND_DOTS, sizeof(Dot));
+    mem_line("particles", (6*sizeof(float) + sizeof(uint32_t)) * PARTICLE_CAP, 6*sizeof(float) + sizeof(uint32_t));
+    mem_line("particle batch", (4*sizeof(SDL_Vertex) + 6*sizeof(int)) * PARTICLE_CAP, 0);
+    mem_line("rollback snapshot", snapshot_bytes, 0);
+    mem_line("rollback ring (netplay)", snapshot_bytes * ROLLBACK_TICKS, 0);
+#ifdef TOMMY_SIM_THREAD
+    mem_line("worker frames (2)", 2 * (round_bytes() + sizeof(SimFrame)), 0);
+#endif
+    mem_line("soft framebuffer", sizeof(uint32_t) * SCREEN_W * SCREEN_H, 0);
+    mem_line("capture queue", sizeof(uint32_t) * SCREEN_W*SCREEN_H * CAPTURE_QUEUE_FRAMES + 3 * SCREEN_W*SCREEN_H, 0);
+    mem_line("hot set per tick", hot_bytes, 0);
+}
+
+/**
+ * Parse a pool capacity from the command line
+ */
+static int parse_capacity(const char *arg) {
+    long n = strtol(arg, NULL, 10);
+    if (n < 1) n = 1;
+    if (n > MAX_POOL_CAPACITY) n = MAX_POOL_CAPACITY;
+    return (int)n;
+}
+
 /**
  * Main game loop
  */
 int main(int argc, char **argv) {
-    (void)argc; (void)argv;
-    srand((unsigned int)time(NULL));
+    const char *capture_path = NULL;
+    const char *suspend_path = "tommy.suspend";
+    bool resume = false;
+    bool headless = false;
+    bool headless_draw = true;
+    const char *hash_path = NULL;
+    bool show_mem = false;
+    NetMode net_mode = NET_OFF;
+    const char *net_host = NULL;
+    int net_port = 27960;
+    int capture_frames = 600;
+    unsigned int seed = (unsigned int)time(NULL);
+    for (int i=1; i<argc; i++) {
+        if (strcmp(argv[i], "--soft-render") == 0) {
+            soft_render = true;
+        } else if (strcmp(argv[i], "--capture") == 0 && i+1 < argc) {
+            capture_path = argv[++i];
+        } else if ((strcmp(argv[i], "--frames") == 0 || strcmp(argv[i], "--ticks") == 0) && i+1 < argc) {
+            capture_frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (strcmp(argv[i], "--no-render") == 0) {
+            headless_draw = false;
+        } else if (strcmp(argv[i], "--hash-log") == 0 && i+1 < argc) {
+            hash_path = argv[++i];
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = true;
+        } else if (strcmp(argv[i], "--late-latch") == 0) {
+#ifdef __EMSCRIPTEN__
+            fprintf(stderr, "late latching is not available in the browser\n");
+#else
+            latch.enabled = true;
+#endif
+        } else if (strcmp(argv[i], "--latency-report") == 0) {
+            latency.enabled = true;
+        } else if (strcmp(argv[i], "--mem-report") == 0) {
+            show_mem = true;
+        } else if (strcmp(argv[i], "--bot") == 0 && i+1 < argc) {
+            const char *name = argv[++i];
+            int n = (int)(sizeof(bot_policies)/sizeof(bot_policies[0]));
+            int k = 0;
+            while (k < n && strcmp(bot_policies[k].name, name) != 0) k++;
+            if (k < n) {
+                bot = &bot_policies[k];
+            } else {
+                fprintf(stderr, "unknown bot policy: %s\n", name);
+            }
+        } else if (strcmp(argv[i], "--horde") == 0) {
+            bullet_cap = HORDE_BULLETS;
+            enemy_cap = HORDE_ENEMIES;
+            prop_cap = HORDE_PROPS;
+        } else if (strcmp(argv[i], "--bullets") == 0 && i+1 < argc) {
+            bullet_cap = parse_capacity(argv[++i]);
+        } else if (strcmp(argv[i], "--enemies") == 0 && i+1 < argc) {
+            enemy_cap = parse_capacity(argv[++i]);
+        } else if (strcmp(argv[i], "--props") == 0 && i+1 < argc) {
+            prop_cap = parse_capacity(argv[++i]);
+        } else if (strcmp(argv[i], "--resume") == 0) {
+            resume = true;
+        } else if (strcmp(argv[i], "--suspend-file") == 0 && i+1 < argc) {
+            suspend_path = argv[++i];
+        } else if (strcmp(argv[i], "--net-loopback") == 0) {
+            net_mode = NET_LOOPBACK;
+        } else if (strcmp(argv[i], "--net-host") == 0 && i+1 < argc) {
+            net_mode = NET_HOST;
+            net_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--net-join") == 0 && i+2 < argc) {
+            net_mode = NET_JOIN;
+            net_host = argv[++i];
+            net_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--net-delay") == 0 && i+1 < argc) {
+            net.delay_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--net-loss") == 0 && i+1 < argc) {
+            net.loss_pct = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--waves") == 0 && i+1 < argc) {
+            const char *name = argv[++i];
+            int n = (int)(sizeof(scenarios)/sizeof(scenarios[0]));
+            int k = 0;
+            while (k < n && strcmp(scenarios[k].name, name) != 0) k++;
+            if (k < n) {
+                scenario = &scenarios[k];
+            } else {
+                fprintf(stderr, "unknown wave scenario: %s\n", name);
+            }
+        } else if (strcmp(argv[i], "--seed") == 0 && i+1 < argc) {
+            seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "unknown option: %s\n", argv[i]);
+        }
+    }
+    rng_seed(seed);
+    bot_seed(seed);
+    if (!particles_init()) SDL_Log("not enough memory for particles, effects disabled");
+    build_circle_spans();
+    build_glyph_rows();
+    if (show_mem) mem_report();
+
+    if (capture_path || headless) {
+        if (SDL_Init(SDL_INIT_TIMER | SDL_INIT_EVENTS) != 0) {
+            SDL_Log("SDL_Init failed: %s", SDL_GetError());
+            return 1;
+        }
+        FILE *hash_log = NULL;
+        if (hash_path && !(hash_log = fopen(hash_path, "w"))) {
+            SDL_Log("cannot write hash log %s", hash_path);
+        }
+        int rc = run_headless(capture_path, capture_frames, headless_draw, hash_log);
+        if (hash_log) fclose(hash_log);
+        particles_free();
+        release_round();
+        SDL_Quit();
+        return rc;
+    }
 
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_EVENTS) != 0) {
         SDL_Log("SDL_Init failed: %s", SDL_GetError());
@@ -991,10 +4220,42 @@ int main(int argc, char **argv) {
     fprintf(stderr, "display count: %d\n", SDL_GetNumVideoDisplays());
     fprintf(stderr, "window flags: 0x%x\n", SDL_GetWindowFlags(win));
 
-    reset_game();
+    // prefer the software rasterizer when SDL could not give us a GPU
+    SDL_RendererInfo info;
+    if (SDL_GetRendererInfo(ren, &info) == 0 && (info.flags & SDL_RENDERER_SOFTWARE)) {
+        soft_render = true;
+    }
+    const char *driver = SDL_GetCurrentVideoDriver();
+    if (driver && (strcmp(driver, "offscreen") == 0 || strcmp(driver, "dummy") == 0)) {
+        soft_render = true;
+    }
+    if (soft_render && !init_soft_render(ren)) {
+        soft_render = false;
+    }
+    fprintf(stderr, "render backend: %s\n", soft_render ? "software" : "sdl");
+
+    uint64_t resume_start = SDL_GetPerformanceCounter();
+    if (net_mode != NET_OFF) {
+        if (!net_init(net_mode, net_host, net_port, seed)) return 1;
+    } else if (resume && resume_round(suspend_path)) {
+        // pick up where the round was left, paused so the player can get ready
+        show_welcome_msg = false;
+        paused = true;
+        fprintf(stderr, "resumed %s in %.3f ms\n", suspend_path,
+            (SDL_GetPerformanceCounter() - resume_start) * 1000.0 / SDL_GetPerformanceFrequency());
+        // a round resumes once; the pages stay mapped where unlinking is allowed,
+        // elsewhere the file goes at exit
+        remove(suspend_path);
+    } else {
+        if (resume) fprintf(stderr, "cannot resume from %s, starting a new round\n", suspend_path);
+        reset_game();
+    }
+
+    if (net.mode == NET_OFF) sim_start();
 
     prev = SDL_GetPerformanceCounter();
     freq = (double)SDL_GetPerformanceFrequency();
+    if (latch.enabled) latch_init();
 
     #ifdef __EMSCRIPTEN__
         emscripten_set_main_loop_arg(update_game, ren, 0, 1);
@@ -1004,6 +4265,26 @@ int main(int argc, char **argv) {
         }
     #endif
 
+    sim_stop();
+
+    // quitting mid-round leaves a suspend file for --resume, anything else
+    // leaves nothing to resume
+    if (net.mode == NET_OFF && any_player_alive() && !game_over && !show_welcome_msg) {
+        if (suspend_round(suspend_path)) {
+            fprintf(stderr, "suspended round to %s\n", suspend_path);
+        } else {
+            fprintf(stderr, "cannot write %s\n", suspend_path);
+        }
+    } else if (net.mode == NET_OFF) {
+        release_round(); // drops a mapping of the file first
+        remove(suspend_path);
+    }
+
+    latency_report();
+    net_close();
+    release_round();
+    particles_free();
+    free_soft_render();
     SDL_DestroyRenderer(ren);
     SDL_DestroyWindow(win);
     SDL_Quit();